@@ -15,16 +15,427 @@
 // includes
 // --------
 
-#include <cassert>   // assert
-#include <cstddef>   // ptrdiff_t, size_t
-#include <new>       // bad_alloc, new
-#include <stdexcept> // invalid_argument
+#include <algorithm>   // sort
+#include <cstddef>     // ptrdiff_t, size_t
+#include <cstdint>     // uintptr_t
+#include <cstdio>      // fprintf
+#include <cstdlib>     // abort
+#include <cstring>     // memcpy, memmove
+#include <functional>  // less
+#include <new>         // bad_alloc, new
+#include <ostream>     // ostream
+#include <stdexcept>   // invalid_argument
+#include <type_traits> // is_trivially_copyable
+
+#include "gtest/gtest_prod.h" // FRIEND_TEST
+
+// ---------------
+// ALLOCATOR_CHECK
+// ---------------
+
+/**
+ * How much of the heap every operation that changes it checks afterwards:
+ * 0 nothing,
+ * 1 the sentinels of the blocks the operation touched and of their neighbours
+ *   and the size class links of those blocks, in O(1),
+ * 2 as 1, plus a full O(n) sweep with valid() once every
+ *   ALLOCATOR_CHECK_PERIOD operations.
+ * A failed check prints the offset of the block and aborts, with or without
+ * NDEBUG. Defaults to 0 if NDEBUG is defined and to 1 otherwise. A full
+ * sweep can be requested at any level with Allocator::check().
+ */
+#ifndef ALLOCATOR_CHECK
+    #ifdef NDEBUG
+        #define ALLOCATOR_CHECK 0
+    #else
+        #define ALLOCATOR_CHECK 1
+    #endif
+#endif
+
+#ifndef ALLOCATOR_CHECK_PERIOD
+    #define ALLOCATOR_CHECK_PERIOD 1
+#endif
+
+// ---------------
+// ALLOCATOR_STATS
+// ---------------
+
+/**
+ * If not 0, every Allocator keeps the counters of an AllocatorStats and
+ * exposes them through Allocator::stats(). If 0, the default, the counters
+ * and the code that updates them are compiled out.
+ */
+#ifndef ALLOCATOR_STATS
+    #define ALLOCATOR_STATS 0
+#endif
+
+// ----------------
+// ALLOCATOR_RECORD
+// ----------------
+
+/**
+ * If not 0, an Allocator can be handed a trace_recorder with
+ * Allocator::record(), and then appends every allocate and deallocate to
+ * it, with the byte offset of the payload in a[] as the id, so the trace
+ * can be replayed into other configurations. If 0, the default, the hooks
+ * are compiled out.
+ */
+#ifndef ALLOCATOR_RECORD
+    #define ALLOCATOR_RECORD 0
+#endif
+
+#if ALLOCATOR_RECORD
+    #include "AllocatorTrace.h"
+#endif
+
+// --------------
+// AllocatorStats
+// --------------
+
+/**
+ * A snapshot of what an Allocator has done, returned by Allocator::stats()
+ * when ALLOCATOR_STATS is not 0. Sizes are payload bytes; the sentinels are
+ * not counted.
+ */
+struct AllocatorStats
+{
+    std::size_t live_bytes;     // in busy blocks
+    std::size_t high_water;     // most live_bytes there have been
+    std::size_t free_bytes;     // in free blocks
+    std::size_t largest_free;   // the largest free block
+    std::size_t allocations;    // successful allocate() calls
+    std::size_t deallocations;  // deallocate() calls
+    std::size_t failures;       // allocate() calls that threw bad_alloc
+    std::size_t blocks_scanned; // blocks looked at while placing requests
+    std::size_t coalesces;      // free neighbours merged by deallocate()
+    std::size_t histogram[32];  // requests by floor(log2(bytes requested))
+
+    /**
+     * O(1) in space
+     * O(1) in time
+     * External fragmentation: 1 - largest_free / free_bytes, 0 when all the
+     * free space is in one block. Near 1, requests fail long before the
+     * heap is full.
+     */
+    double fragmentation () const
+    {
+        return free_bytes == 0 ? 0 : 1 - static_cast<double>(largest_free) / free_bytes;
+    }
+
+    /**
+     * O(1) in space
+     * O(1) in time
+     * The mean number of blocks looked at per allocate() call
+     */
+    double scanned_per_allocate () const
+    {
+        std::size_t calls = allocations + failures;
+        return calls == 0 ? 0 : static_cast<double>(blocks_scanned) / calls;
+    }
+
+    /**
+     * O(1) in space
+     * O(1) in time
+     * Writes the snapshot as one JSON object
+     * @param out the stream to write to
+     */
+    void write_json (std::ostream& out) const
+    {
+        out << "{\"live_bytes\":"           << live_bytes
+            << ",\"high_water\":"           << high_water
+            << ",\"free_bytes\":"           << free_bytes
+            << ",\"largest_free\":"         << largest_free
+            << ",\"fragmentation\":"        << fragmentation()
+            << ",\"allocations\":"          << allocations
+            << ",\"deallocations\":"        << deallocations
+            << ",\"failures\":"             << failures
+            << ",\"blocks_scanned\":"       << blocks_scanned
+            << ",\"scanned_per_allocate\":" << scanned_per_allocate()
+            << ",\"coalesces\":"            << coalesces
+            << ",\"histogram\":[";
+        for (int i = 0; i != 32; ++i)
+        {
+            out << (i == 0 ? "" : ",") << histogram[i];
+        }
+        out << "]}";
+    }
+};
+
+// -------------
+// allocator_log2
+// -------------
+
+/**
+ * O(1) in space
+ * O(log n) in time
+ * floor(log2(n)) for n > 0, and 0 for n == 0, usable in constant expressions
+ * @param n the value to take the logarithm of
+ * @return the position of the most significant set bit of n
+ */
+constexpr int allocator_log2 (std::size_t n)
+{
+    return n < 2 ? 0 : 1 + allocator_log2(n / 2);
+}
+
+// ------------------
+// allocator_round_up
+// ------------------
+
+/**
+ * O(1) in space
+ * O(1) in time
+ * n rounded up to a multiple of m, usable in constant expressions
+ */
+constexpr std::size_t allocator_round_up (std::size_t n, std::size_t m)
+{
+    return (n + m - 1) / m * m;
+}
+
+// ---------------
+// allocator_slots
+// ---------------
+
+/**
+ * O(1) in space
+ * O(1) in time, as the first guess is at most a few slots too many
+ * The most slots of size bytes, aligned to align, that fit in n bytes after
+ * a bitmap of one bit per slot, usable in constant expressions
+ * @param s a first guess, counted down until the slots fit
+ */
+constexpr std::size_t allocator_slots (std::size_t n, std::size_t size, std::size_t align,
+                                       std::size_t s)
+{
+    return s == 0 || allocator_round_up((s + 31) / 32 * sizeof(unsigned), align) + s * size <= n ?
+           s : allocator_slots(n, size, align, s - 1);
+}
+
+// ------------------
+// placement policies
+// ------------------
+
+/**
+ * Base of the placement policies. A policy chooses the free block that
+ * Allocator::allocate places a request in; find returns the offset of that
+ * block's beginning sentinel, or -1 if the policy finds none. Policies that
+ * remember block offsets between calls are told through merged whenever a
+ * block disappears because it was coalesced into another one.
+ */
+struct PlacementPolicy
+{
+    /**
+     * O(1) in space
+     * O(1) in time
+     * Called when the block at from is coalesced into the block at into
+     */
+    void merged (int, int)
+    {}
+};
+
+/**
+ * O(1) in space
+ * O(1) in time
+ * Takes the first block of the smallest size class that is guaranteed to fit,
+ * found with the size class bitmaps; the default
+ */
+struct GoodFit : PlacementPolicy
+{
+    template <typename A>
+    int find (const A& heap, int bytes_needed)
+    {
+        return heap.find_free(bytes_needed);
+    }
+};
+
+/**
+ * O(1) in space
+ * O(n) in time
+ * Takes the first block that fits in address order, walking every block
+ */
+struct FirstFit : PlacementPolicy
+{
+    template <typename A>
+    int find (const A& heap, int bytes_needed)
+    {
+        for (int block = 0; block != -1; block = heap.next_block(block))
+        {
+            heap.scanned();
+            if (heap[block] >= bytes_needed)
+            {
+                return block;
+            }
+        }
+        return -1;
+    }
+};
+
+/**
+ * O(1) in space
+ * O(n) in time
+ * Takes the first block that fits in address order, starting from the block
+ * the previous search ended at and wrapping around the end of a[]
+ */
+struct NextFit : PlacementPolicy
+{
+    /**
+     * Offset of the block the previous search ended at
+     */
+    int rover;
+
+    NextFit () :
+        rover(0)
+    {}
+
+    template <typename A>
+    int find (const A& heap, int bytes_needed)
+    {
+        int block = rover;
+        do
+        {
+            heap.scanned();
+            if (heap[block] >= bytes_needed)
+            {
+                rover = block;
+                return block;
+            }
+            block = heap.next_block(block);
+            if (block == -1)
+            {
+                block = 0;
+            }
+        }
+        while (block != rover);
+        return -1;
+    }
+
+    void merged (int from, int into)
+    {
+        if (rover == from)
+        {
+            rover = into;
+        }
+    }
+};
+
+/**
+ * O(1) in space
+ * O(f) in time, where f is the number of blocks in one size class
+ * Takes the smallest block that fits. Blocks in a lower size class are all too
+ * small and every block in a higher one fits, so only the request's own class
+ * and the first non-empty class above it are searched.
+ */
+struct BestFit : PlacementPolicy
+{
+    template <typename A>
+    int find (const A& heap, int bytes_needed)
+    {
+        int fl;
+        int sl;
+        A::mapping(bytes_needed, fl, sl);
+        int best = smallest(heap, heap.bins[fl][sl], bytes_needed);
+        if (best == -1 && heap.first_class_from(fl, ++sl))
+        {
+            best = smallest(heap, heap.bins[fl][sl], bytes_needed);
+        }
+        return best;
+    }
+
+    /**
+     * The smallest block of at least bytes_needed in the class starting at
+     * block, or -1
+     */
+    template <typename A>
+    static int smallest (const A& heap, int block, int bytes_needed)
+    {
+        int best = -1;
+        for (; block != -1; block = heap.next_free(block))
+        {
+            heap.scanned();
+            if (heap[block] >= bytes_needed &&
+                (best == -1 || heap[block] < heap[best]))
+            {
+                best = block;
+            }
+        }
+        return best;
+    }
+};
+
+/**
+ * O(1) in space
+ * O(f) in time, where f is the number of blocks in one size class
+ * Takes the largest block, which is in the highest non-empty size class
+ */
+struct WorstFit : PlacementPolicy
+{
+    template <typename A>
+    int find (const A& heap, int bytes_needed)
+    {
+        if (heap.fl_bitmap == 0)
+        {
+            return -1;
+        }
+        int fl = 31 - __builtin_clz(heap.fl_bitmap);
+        int sl = 31 - __builtin_clz(heap.sl_bitmap[fl]);
+
+        int worst = heap.bins[fl][sl];
+        for (int block = worst; block != -1; block = heap.next_free(block))
+        {
+            heap.scanned();
+            if (heap[block] > heap[worst])
+            {
+                worst = block;
+            }
+        }
+        return heap[worst] >= bytes_needed ? worst : -1;
+    }
+};
+
+/**
+ * Not a placement policy: Allocator<T, N, Slab> is a slab of fixed-size
+ * slots of one T each, specialized below
+ */
+struct Slab
+{};
+
+/**
+ * A stand-in for the node of a node container of Vs: links pointers, then
+ * room for a V aligned for it, as std::list (2 links) and std::map and
+ * std::set (4, the colour padded to a pointer) lay their nodes out. An
+ * Allocator<allocator_node<V, links>, N, Slab> has slots of a node each,
+ * which an ArenaAllocator over it hands to the container one per node.
+ */
+template <typename V, std::size_t Links>
+struct allocator_node
+{
+    void*                    links[Links];
+    alignas(V) unsigned char value[sizeof(V)];
+};
+
+// --------------
+// allocator_lazy
+// --------------
+
+/**
+ * Selects the constructor of Allocator that leaves a[] untouched
+ */
+struct allocator_lazy_t
+{};
+
+const allocator_lazy_t allocator_lazy = allocator_lazy_t();
 
 // ---------
 // Allocator
 // ---------
 
-template <typename T, std::size_t N>
+/**
+ * A heap of N bytes kept in a[] as blocks bounded by a pair of int sentinels
+ * holding the payload size, positive if the block is free and negative if it
+ * is busy. Policy chooses which free block a request is placed in. Every
+ * payload is aligned for T, and allocate_aligned aligns one further. An
+ * Allocator of a T aligned to more than 16 bytes needs static or automatic
+ * storage before C++17, whose new is the first to honour that alignment.
+ */
+template <typename T, std::size_t N, typename Policy = GoodFit>
 class Allocator
 {
     public:
@@ -48,9 +459,13 @@ class Allocator
         // operator ==
         // -----------
 
-        friend bool operator == (const Allocator&, const Allocator&)
+        /**
+         * Every Allocator, copies included, has its own a[], so a block can
+         * only be deallocated by the allocator it came from
+         */
+        friend bool operator == (const Allocator& lhs, const Allocator& rhs)
         {
-            return true; // this is correct
+            return &lhs == &rhs;
         }
 
         // -----------
@@ -67,8 +482,102 @@ class Allocator
         // data
         // ----
 
+        friend Policy;
+
+        /**
+         * A payload starts sizeof(int) bytes into its block, so lead puts
+         * a[] sizeof(int) bytes before a multiple of lead_align. Every block
+         * starts at an offset into a[] that is a multiple of alignof(T),
+         * which then keeps every payload aligned for T.
+         */
+        static constexpr std::size_t lead_align = alignof(T) > 2 * sizeof(int) ?
+                                                  alignof(T) : 2 * sizeof(int);
+
+        alignas(lead_align) char lead[lead_align - sizeof(int)];
         char a[N];
 
+        /**
+         * Free blocks are kept in segregated size classes. A size s falls in
+         * first level class floor(log2(s)) and, within that, in one of
+         * sl_count second level classes given by the sl_log2 bits below the
+         * most significant one. Sizes smaller than sl_count share first level
+         * class 0, one size per second level class. fl_count is the number of
+         * first level classes a[] can need.
+         */
+        static constexpr int sl_log2  = 3;
+        static constexpr int sl_count = 1 << sl_log2;
+        static constexpr int fl_count = allocator_log2(N) >= sl_log2 ?
+                                        allocator_log2(N) - sl_log2 + 2 : 1;
+
+        /**
+         * How far allocate_near looks for a free block on either side of its
+         * hint, in bytes: a page
+         */
+        static constexpr int near_distance = 4096;
+
+        /**
+         * Every payload is at least min_payload bytes, so that every free
+         * block can hold the links of its size class, and a free block split
+         * off another is at least min_block bytes, sentinels included, so
+         * that it can also hold a T
+         */
+        static constexpr std::size_t min_payload = 2 * sizeof(int);
+        static constexpr std::size_t min_block   = 2 * sizeof(int) +
+                                                   (sizeof(T) > min_payload ? sizeof(T) : min_payload);
+
+        /**
+         * Offset of the beginning sentinel of the first block in each size
+         * class, or -1 if the class is empty. Every class is a doubly linked
+         * list threaded through the payload of its free blocks: the first int
+         * of the payload holds the offset of the next free block, the second
+         * int the offset of the previous one.
+         */
+        int bins[fl_count][sl_count];
+
+        /**
+         * Bit fl is set if any second level class of first level class fl is
+         * non-empty, and bit sl of sl_bitmap[fl] is set if bins[fl][sl] is
+         * non-empty, so a non-empty class is found with find-first-set.
+         */
+        unsigned fl_bitmap;
+        unsigned sl_bitmap[fl_count];
+
+        /**
+         * The placement policy, which may keep state of its own
+         */
+        Policy policy;
+
+        #if ALLOCATOR_CHECK >= 2
+        /**
+         * Number of operations since the last full sweep
+         */
+        std::size_t unchecked;
+        #endif
+
+        #if ALLOCATOR_STATS
+        /**
+         * The counters behind stats(); largest_free is only filled in by it.
+         * Mutable so that the const searches can count the blocks they scan.
+         */
+        mutable AllocatorStats counters;
+        #endif
+
+        #if ALLOCATOR_RECORD
+        /**
+         * Where every operation is recorded, or nullptr
+         */
+        trace_recorder* recorder;
+        #endif
+
+        /**
+         * The blocks cover a[0, frontier); the bytes from frontier on have
+         * never been written. The default constructor sets it to N; a lazy
+         * Allocator starts it at 0 and moves it up only when the free
+         * blocks cannot hold a request, so pages that are never handed out
+         * are never touched.
+         */
+        int frontier;
+
         // ----------------------
         // bytes_to_next_sentinel
         // ----------------------
@@ -102,12 +611,20 @@ class Allocator
          * O(1) in space
          * O(n) in time
          * Class invariant used to check whether a given Allocator is in a valid
-         * state after construction or a call to allocate or deallocate.
+         * state, by check() and by the full sweeps of ALLOCATOR_CHECK 2.
          * Checks that sentinel pairs match, there are not uncoalesced blocks.
          * @return a bool value representing whether or not a[] is a valid heap
          */
         bool valid () const
         {
+            if (frontier < 0 || static_cast<size_t>(frontier) > N)
+            {
+                return false;
+            }
+            if (frontier == 0)
+            {
+                return valid_free_list();
+            }
 
             // To avoid dealing with checking the validity of the first pair
             // of sentinels (a special case) check the first pair outside
@@ -135,12 +652,12 @@ class Allocator
             bytes_read += sizeof(int);
 
             // Check the rest of the sentinels for validity
-            while (bytes_read < N)
+            while (bytes_read < static_cast<size_t>(frontier))
             {
                 current_sentinel = (*this)[bytes_read];
             
-                // Sentinels cannot be 0
-                if (current_sentinel == 0)
+                // Sentinels cannot be 0, and payloads must be aligned
+                if (current_sentinel == 0 || bytes_read % alignof(T) != 0)
                 {
                     return false;
                 }
@@ -166,325 +683,2363 @@ class Allocator
                 // Increments bytes_read to the next sentinel
                 bytes_read += sizeof(int);
             }
-            return true;
+            return valid_free_list();
         }
 
-        // -----------
-        // operator []
-        // -----------
-
         /**
          * O(1) in space
-         * O(1) in time
-         * Read a sentinel from a[], cast value to an int as a[] is a char
-         * array, and dereference it
-         * https://code.google.com/p/googletest/wiki/
-         *     AdvancedGuide#Private_Class_Members
+         * O(n) in time
+         * Helper for valid() that checks the size classes against the
+         * sentinels: every linked block must be free, big enough for the links
+         * and in the class its size maps to, the prev links must mirror the
+         * next links, the bitmaps must match the classes, and every free block
+         * must be in a class.
+         * @return a bool value representing whether the size classes are valid
          */
-        FRIEND_TEST(TestIndexOperator, index_1); 
-        FRIEND_TEST(TestIndexOperator, index_2);
-        int& operator [] (int i)
+        bool valid_free_list () const
         {
-            return *reinterpret_cast<int*>(&a[i]);
+            // Count the free blocks the sentinels say there are
+            size_t linked = 0;
+            size_t bytes_read = 0;
+            while (bytes_read < static_cast<size_t>(frontier))
+            {
+                int current_sentinel = (*this)[bytes_read];
+                if (current_sentinel > 0)
+                {
+                    if (current_sentinel < static_cast<int>(min_payload))
+                    {
+                        return false;
+                    }
+                    ++linked;
+                }
+                bytes_read += bytes_to_next_sentinel(current_sentinel) + sizeof(int);
+            }
+
+            // Walk every class, never further than the number of free blocks
+            // so that a cycle cannot hang the check
+            unsigned fl_map = 0;
+            for (int fl = 0; fl < fl_count; ++fl)
+            {
+                unsigned sl_map = 0;
+                for (int sl = 0; sl < sl_count; ++sl)
+                {
+                    int prev = -1;
+                    int block = bins[fl][sl];
+                    while (block != -1)
+                    {
+                        if (linked == 0 ||
+                            block < 0 || block >= frontier ||
+                            (*this)[block] < static_cast<int>(min_payload) ||
+                            (*this)[block + 2 * sizeof(int)] != prev)
+                        {
+                            return false;
+                        }
+                        int block_fl;
+                        int block_sl;
+                        mapping((*this)[block], block_fl, block_sl);
+                        if (block_fl != fl || block_sl != sl)
+                        {
+                            return false;
+                        }
+                        --linked;
+                        prev = block;
+                        block = (*this)[block + sizeof(int)];
+                    }
+                    if (bins[fl][sl] != -1)
+                    {
+                        sl_map |= 1u << sl;
+                    }
+                }
+                if (sl_map != sl_bitmap[fl])
+                {
+                    return false;
+                }
+                if (sl_map != 0)
+                {
+                    fl_map |= 1u << fl;
+                }
+            }
+            if (fl_map != fl_bitmap)
+            {
+                return false;
+            }
+            return linked == 0;
         }
 
         /**
-         * Helper method for allocate that checks if a given block should be 
-         * allocated and/or split into two smaller blocks. Returns a pointer to 
-         * the allocated area if appropriate, and a null pointer otherwise.
-         * @param bytes_read the number of bytes read in a[] at this point
-         * @param current_sentinel the value of the block's sentinel that this
-         *                         function is trying to allocate room in
-         * @param bytes_needed the number of bytes needed for allocation
-         * @param n the number of Ts to allocate
+         * O(1) in space
+         * O(1) in time
+         * Local version of valid() for the block at offset block: checks that
+         * its sentinels and those of the blocks on either side of it match,
+         * that it is not a free block next to another free block, and that
+         * the size class links of a linked free block point back to it.
+         * @param block the offset of a block's beginning sentinel
+         * @return a bool value representing whether the block looks valid
          */
-        pointer allocate_if_possible(size_t bytes_read, int current_sentinel, 
-                                     int bytes_needed, size_t n)
-        {            
-            // If there is enough space in this block, allocate:
-            if (current_sentinel >= bytes_needed && current_sentinel > 0)
+        FRIEND_TEST(TestCheck, valid_block_1);
+        FRIEND_TEST(TestCheck, valid_block_2);
+        FRIEND_TEST(TestCheck, valid_block_3);
+        bool valid_block (int block) const
+        {
+            size_t limit = frontier;
+            if (block < 0 || static_cast<size_t>(block) + 2 * sizeof(int) > limit ||
+                block % alignof(T) != 0)
             {
-                // Calculate the remaining space there would be in this block if
-                // n Ts have been allocated
-                int remaining_space = current_sentinel + (2 * sizeof(int)) - 
-                                      ((2 * sizeof(int)) + (n * sizeof(T)));
+                return false;
+            }
+            int sentinel = (*this)[block];
+            size_t end = block + bytes_to_next_sentinel(sentinel);
+            if (sentinel == 0 || end + sizeof(int) > limit || (*this)[end] != sentinel)
+            {
+                return false;
+            }
 
-                // If there is enough space to allocate n Ts AND another block
-                // that is AT LEAST bigger than the "smallest allowable block",
-                // create two more sentinels to designate the latter
-                if (remaining_space >= (2 * sizeof(int) + sizeof(T)))
+            // The block before this one
+            if (block != 0)
+            {
+                int previous = (*this)[block - sizeof(int)];
+                size_t size = bytes_to_next_sentinel(previous);
+                if (previous == 0 || size + sizeof(int) > static_cast<size_t>(block) ||
+                    (*this)[block - size - sizeof(int)] != previous ||
+                    (previous > 0 && sentinel > 0))
                 {
-                    // Create pointer to beginning of allocated space
-                    bytes_read += sizeof(int);
-                    pointer p = reinterpret_cast<pointer>(&a[bytes_read]);
+                    return false;
+                }
+            }
 
-                    // Modify first sentinel to new value
-                    (*this)[bytes_read - sizeof(int)] = bytes_needed * -1;
+            // The block after this one
+            if (end + sizeof(int) != limit)
+            {
+                int next = (*this)[end + sizeof(int)];
+                size_t next_end = end + sizeof(int) + bytes_to_next_sentinel(next);
+                if (next == 0 || next_end + sizeof(int) > limit ||
+                    (*this)[next_end] != next ||
+                    (next > 0 && sentinel > 0))
+                {
+                    return false;
+                }
+            }
 
-                    // Go to second sentinel
-                    bytes_read += bytes_needed;
-                    
-                    // Create an end sentinel
-                    (*this)[bytes_read] = bytes_needed * -1;
-                   
-                    // Go to first in second group of sentinels
-                    bytes_read += sizeof(int);
-                    
-                    // Create first sentinel in second group
-                    (*this)[bytes_read] = remaining_space - 2 * sizeof(int);
-                    
-                    // Create second sentinel in second group
-                    bytes_read += remaining_space - sizeof(int);
-                    
-                    (*this)[bytes_read] = remaining_space - 2 * sizeof(int);
-                    
-                    assert(valid());
-                    return p;
+            // The size class links
+            if (sentinel > 0)
+            {
+                int next = next_free(block);
+                int prev = (*this)[block + 2 * sizeof(int)];
+                if ((next != -1 && (next < 0 || next >= frontier ||
+                                    (*this)[next] <= 0 ||
+                                    (*this)[next + 2 * sizeof(int)] != block)) ||
+                    (prev != -1 && (prev < 0 || prev >= frontier ||
+                                    (*this)[prev] <= 0 ||
+                                    next_free(prev) != block)))
+                {
+                    return false;
                 }
-                // If there's not enough space for another T and 2 sentinels, 
-                // just fill in this block
-                else
+                int fl;
+                int sl;
+                mapping(sentinel, fl, sl);
+                if (prev == -1 && bins[fl][sl] != block)
                 {
-                    pointer p = reinterpret_cast<pointer>(&a[bytes_read + sizeof(int)]);
-
-                    // Mark current pair of sentinels as "used"
-                    (*this)[bytes_read] *= -1;
-                    (*this)[bytes_read + current_sentinel + sizeof(int)] *= -1;
-
-                    assert(valid());
-                    return p;
+                    return false;
                 }
             }
-
-            // Return null pointer if this block was not suitable
-            return nullptr;
+            return true;
         }
 
-    public:
-        // ------------
-        // constructors
-        // ------------
-
         /**
          * O(1) in space
-         * O(1) in time
-         * throw a bad_alloc exception, if N is less than sizeof(T) + 
-         * (2 * sizeof(int))
+         * O(1) in time, O(n) when a full sweep is due
+         * Checks the heap after an operation that changed the blocks around
+         * block, as much as ALLOCATOR_CHECK asks for, and aborts if it is not
+         * valid
+         * @param block the offset of the beginning sentinel of the block the
+         *              operation produced
          */
-        Allocator ()
+        void checked (int block)
         {
-            size_t sentinels_size = 2 * sizeof(int);
-
-            if (N < sizeof(T) + sentinels_size)
+            #if ALLOCATOR_CHECK >= 1
+            if (!valid_block(block))
             {
-                std::bad_alloc exception;
-                throw exception;
+                corrupt(block);
             }
+            #else
+            (void) block;
+            #endif
 
-            // Set sentinels
-            (*this)[0] = N - sentinels_size;
-            (*this)[N - sizeof(int)] = N - sentinels_size;
-
-            assert(valid());
+            #if ALLOCATOR_CHECK >= 2
+            if (++unchecked == ALLOCATOR_CHECK_PERIOD)
+            {
+                unchecked = 0;
+                if (!valid())
+                {
+                    corrupt(-1);
+                }
+            }
+            #endif
         }
 
-        // Default copy, destructor, and copy assignment
-        // Allocator  (const Allocator&);
-        // ~Allocator ();
-        // Allocator& operator = (const Allocator&);
-
-        // --------
-        // allocate
-        // --------
-
-        FRIEND_TEST(TestAllocate, allocate_1);
-        FRIEND_TEST(TestAllocate, allocate_2);
-        FRIEND_TEST(TestAllocate, allocate_3);
-        FRIEND_TEST(TestAllocate, allocate_4);
-        FRIEND_TEST(TestAllocate, allocate_5);
-        FRIEND_TEST(TestAllocate, allocate_6);
-        FRIEND_TEST(TestAllocate, allocate_7);
-
         /**
-         * O(1) in space
-         * O(n) in time
-         * Allocates at least enough space for n T's when requested
-         * After allocation there must be enough space left for a valid block
-         * the smallest allowable block is sizeof(T) + (2 * sizeof(int))
-         * choose the first block that fits
-         * Throw a bad_alloc exception, if n is invalid
+         * Reports a failed check and aborts
+         * @param block the offset of the block that failed a local check, or
+         *              -1 if a full sweep failed
          */
-        pointer allocate (const size_type& n)
+        void corrupt (int block) const
         {
-            if ((n * sizeof(T)) > N)
+            if (block == -1)
             {
-                std::bad_alloc e;
-                throw e;
+                std::fprintf(stderr, "Allocator: heap at %p is corrupt\n",
+                             static_cast<const void*>(a));
             }
-            if (n == 0)
+            else
             {
-                return nullptr;
+                std::fprintf(stderr, "Allocator: block %d of heap at %p is corrupt\n",
+                             block, static_cast<const void*>(a));
             }
+            std::abort();
+        }
 
-            // Check if n Ts can be allocated in the first block
-            size_t bytes_read = 0;
-            int current_sentinel = (*this)[0];
-            size_t bytes_needed = n * sizeof(T);
-            pointer p = allocate_if_possible(bytes_read, current_sentinel, bytes_needed, n);
+        // -----------
+        // operator []
+        // -----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Read a sentinel from a[], cast value to an int as a[] is a char
+         * array, and dereference it
+         * https://code.google.com/p/googletest/wiki/
+         *     AdvancedGuide#Private_Class_Members
+         */
+        FRIEND_TEST(TestIndexOperator, index_1); 
+        FRIEND_TEST(TestIndexOperator, index_2);
+        int& operator [] (int i)
+        {
+            return *reinterpret_cast<int*>(&a[i]);
+        }
+
+        // ------------
+        // size classes
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The offset of the free block after block in its size class
+         * @param block the offset of a linked free block's beginning sentinel
+         */
+        FRIEND_TEST(TestFreeList, free_list_1);
+        FRIEND_TEST(TestFreeList, free_list_2);
+        FRIEND_TEST(TestFreeList, free_list_3);
+        FRIEND_TEST(TestSizeClasses, mapping_1);
+        FRIEND_TEST(TestSizeClasses, mapping_2);
+        FRIEND_TEST(TestSizeClasses, find_free_1);
+        FRIEND_TEST(TestSizeClasses, find_free_2);
+        int& next_free (int block)
+        {
+            return (*this)[block + sizeof(int)];
+        }
+
+        int next_free (int block) const
+        {
+            return (*this)[block + sizeof(int)];
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The offset of the free block before block in its size class
+         * @param block the offset of a linked free block's beginning sentinel
+         */
+        int& prev_free (int block)
+        {
+            return (*this)[block + 2 * sizeof(int)];
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Maps a block size to its first and second level size class
+         * @param size a positive block size
+         * @param fl set to the first level class
+         * @param sl set to the second level class
+         */
+        static void mapping (int size, int& fl, int& sl)
+        {
+            int msb = 31 - __builtin_clz(static_cast<unsigned>(size));
+            if (msb < sl_log2)
+            {
+                fl = 0;
+                sl = size;
+            }
+            else
+            {
+                fl = msb - sl_log2 + 1;
+                sl = (size >> (msb - sl_log2)) - sl_count;
+            }
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The head of the size class that a free block of size belongs in
+         * @param size the (positive) sentinel value of a free block
+         */
+        int& bin_head (int size)
+        {
+            int fl;
+            int sl;
+            mapping(size, fl, sl);
+            return bins[fl][sl];
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Records a newly created free block, pushing it onto the front of its
+         * size class
+         * @param block the offset of the free block's beginning sentinel
+         */
+        void insert_free (int block)
+        {
+            int fl;
+            int sl;
+            mapping((*this)[block], fl, sl);
+
+            int& head = bins[fl][sl];
+            next_free(block) = head;
+            prev_free(block) = -1;
+            if (head != -1)
+            {
+                prev_free(head) = block;
+            }
+            head = block;
+
+            fl_bitmap     |= 1u << fl;
+            sl_bitmap[fl] |= 1u << sl;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Forgets a free block that is about to be allocated or coalesced,
+         * unlinking it from its size class
+         * @param block the offset of the free block's beginning sentinel
+         */
+        void remove_free (int block)
+        {
+            int fl;
+            int sl;
+            mapping((*this)[block], fl, sl);
+
+            int next = next_free(block);
+            int prev = prev_free(block);
+            if (next != -1)
+            {
+                prev_free(next) = prev;
+            }
+            if (prev != -1)
+            {
+                next_free(prev) = next;
+            }
+            else
+            {
+                bins[fl][sl] = next;
+            }
+
+            // Clear the bitmap bits of a class that is now empty
+            if (bins[fl][sl] == -1)
+            {
+                sl_bitmap[fl] &= ~(1u << sl);
+                if (sl_bitmap[fl] == 0)
+                {
+                    fl_bitmap &= ~(1u << fl);
+                }
+            }
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Finds the first non-empty size class at or after class (fl, sl),
+         * using find-first-set on the bitmaps
+         * @param fl the first level class to start at, set to the one found
+         * @param sl the second level class to start at, set to the one found
+         * @return true if a non-empty class was found
+         */
+        bool first_class_from (int& fl, int& sl) const
+        {
+            if (fl >= fl_count)
+            {
+                return false;
+            }
+            unsigned sl_map = sl < sl_count ? sl_bitmap[fl] & (~0u << sl) : 0;
+            if (sl_map == 0)
+            {
+                unsigned fl_map = fl_bitmap & (~0u << (fl + 1));
+                if (fl_map == 0)
+                {
+                    return false;
+                }
+                fl = __builtin_ctz(fl_map);
+                sl_map = sl_bitmap[fl];
+            }
+            sl = __builtin_ctz(sl_map);
+            return true;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time, unless only the request's own size class can hold it
+         * Finds a linked free block that can hold bytes_needed. The request is
+         * rounded up to the next class boundary so that any block in the
+         * first non-empty class at or above it fits. Only if there is none are
+         * the blocks in the request's own class, which may or may not fit,
+         * searched one by one.
+         * @param bytes_needed the payload size being requested
+         * @return the offset of a suitable block's beginning sentinel, or -1
+         */
+        int find_free (int bytes_needed) const
+        {
+            int fl;
+            int sl;
+            int msb = 31 - __builtin_clz(static_cast<unsigned>(bytes_needed));
+            int rounded = bytes_needed;
+            if (msb >= sl_log2)
+            {
+                rounded += (1 << (msb - sl_log2)) - 1;
+            }
+            mapping(rounded, fl, sl);
+
+            if (first_class_from(fl, sl))
+            {
+                scanned();
+                return bins[fl][sl];
+            }
+
+            // The request's own class may still hold a block that is big
+            // enough
+            mapping(bytes_needed, fl, sl);
+            if (fl < fl_count)
+            {
+                for (int block = bins[fl][sl]; block != -1; block = next_free(block))
+                {
+                    scanned();
+                    if ((*this)[block] >= bytes_needed)
+                    {
+                        return block;
+                    }
+                }
+            }
+            return -1;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The block that follows block in a[]
+         * @param block the offset of a block's beginning sentinel
+         * @return the offset of the next block's beginning sentinel, or -1 if
+         *         block is the last one
+         */
+        int next_block (int block) const
+        {
+            size_t next = block + bytes_to_next_sentinel((*this)[block]) + sizeof(int);
+            return next < static_cast<size_t>(frontier) ? static_cast<int>(next) : -1;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The block that comes before block in a[]
+         * @param block the offset of a block's beginning sentinel
+         * @return the offset of the previous block's beginning sentinel, or
+         *         -1 if block is the first one
+         */
+        int prev_block (int block) const
+        {
+            if (block == 0)
+            {
+                return -1;
+            }
+            return block - bytes_to_next_sentinel((*this)[block - sizeof(int)]) - sizeof(int);
+        }
+
+        // --------
+        // counters
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Counts one block looked at while placing a request
+         */
+        void scanned () const
+        {
+            #if ALLOCATOR_STATS
+            ++counters.blocks_scanned;
+            #endif
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Counts a block of payload size bytes being handed out
+         * @param size the payload size of the block, now busy
+         * @param free_bytes how much the free space shrank by
+         */
+        void counted_allocate (int size, int free_bytes)
+        {
+            #if ALLOCATOR_STATS
+            ++counters.allocations;
+            counters.live_bytes += size;
+            counters.free_bytes -= free_bytes;
+            if (counters.live_bytes > counters.high_water)
+            {
+                counters.high_water = counters.live_bytes;
+            }
+            #else
+            (void) size;
+            (void) free_bytes;
+            #endif
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Counts a busy block of payload size bytes being freed
+         * @param size the payload size of the block, before coalescing
+         * @param merges the number of free neighbours it was coalesced with
+         */
+        void counted_deallocate (int size, int merges)
+        {
+            #if ALLOCATOR_STATS
+            ++counters.deallocations;
+            counters.coalesces  += merges;
+            counters.live_bytes -= size;
+            counters.free_bytes += size + merges * 2 * sizeof(int);
+            #else
+            (void) size;
+            (void) merges;
+            #endif
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Records p being handed out for a request of bytes bytes
+         * @param p the payload of a busy block
+         * @param bytes the bytes requested
+         * @return p
+         */
+        pointer traced_allocate (pointer p, std::size_t bytes)
+        {
+            #if ALLOCATOR_RECORD
+            if (recorder != nullptr)
+            {
+                recorder->record(trace_allocate, reinterpret_cast<char*>(p) - a,
+                                 static_cast<std::uint32_t>(bytes));
+            }
+            #else
+            (void) bytes;
+            #endif
+            return p;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Records p being given back
+         * @param p the payload of a block that was busy
+         * @param bytes the bytes it was requested with
+         */
+        void traced_deallocate (const_pointer p, std::size_t bytes)
+        {
+            #if ALLOCATOR_RECORD
+            if (recorder != nullptr)
+            {
+                recorder->record(trace_deallocate, reinterpret_cast<const char*>(p) - a,
+                                 static_cast<std::uint32_t>(bytes));
+            }
+            #else
+            (void) p;
+            (void) bytes;
+            #endif
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Records a resize as the old block given back and the new one
+         * handed out, which is how a trace replays it
+         * @param p the payload before
+         * @param q the payload after, possibly p
+         * @param old_bytes the bytes p was requested with
+         * @param new_bytes the bytes q holds now
+         */
+        void traced_resize (const_pointer p, pointer q, std::size_t old_bytes,
+                            std::size_t new_bytes)
+        {
+            traced_deallocate(p, old_bytes);
+            traced_allocate(q, new_bytes);
+        }
+
+        /**
+         * Helper method for allocate that checks if a given block should be 
+         * allocated and/or split into two smaller blocks. Returns a pointer to 
+         * the allocated area if appropriate, and a null pointer otherwise.
+         * @param bytes_read the number of bytes read in a[] at this point
+         * @param current_sentinel the value of the block's sentinel that this
+         *                         function is trying to allocate room in
+         * @param bytes_needed the number of bytes needed for allocation, as
+         *                     payload rounds them
+         */
+        pointer allocate_if_possible(size_t bytes_read, int current_sentinel, 
+                                     int bytes_needed)
+        {            
+            // If there is enough space in this block, allocate:
+            if (current_sentinel >= bytes_needed && current_sentinel > 0)
+            {
+                // Calculate the remaining space there would be in this block if
+                // bytes_needed have been allocated
+                int remaining_space = current_sentinel + (2 * sizeof(int)) - 
+                                      ((2 * sizeof(int)) + bytes_needed);
+
+                // If there is enough space to allocate n Ts AND another block
+                // that is AT LEAST bigger than the "smallest allowable block",
+                // create two more sentinels to designate the latter
+                if (remaining_space >= static_cast<int>(min_block))
+                {
+                    // Take the block out of its size class before its payload
+                    // is handed out and its links are overwritten
+                    int block = bytes_read;
+                    remove_free(block);
+
+                    // Create pointer to beginning of allocated space
+                    bytes_read += sizeof(int);
+                    pointer p = reinterpret_cast<pointer>(&a[bytes_read]);
+
+                    // Modify first sentinel to new value
+                    (*this)[bytes_read - sizeof(int)] = bytes_needed * -1;
+
+                    // Go to second sentinel
+                    bytes_read += bytes_needed;
+                    
+                    // Create an end sentinel
+                    (*this)[bytes_read] = bytes_needed * -1;
+                   
+                    // Go to first in second group of sentinels
+                    bytes_read += sizeof(int);
+                    
+                    // Create first sentinel in second group
+                    size_t second_group = bytes_read;
+                    (*this)[bytes_read] = remaining_space - 2 * sizeof(int);
+                    
+                    // Create second sentinel in second group
+                    bytes_read += remaining_space - sizeof(int);
+                    
+                    (*this)[bytes_read] = remaining_space - 2 * sizeof(int);
+
+                    // Put the second group in its size class
+                    insert_free(second_group);
+                    counted_allocate(bytes_needed, bytes_needed + 2 * sizeof(int));
+
+                    checked(block);
+                    return p;
+                }
+                // If there's not enough space for another T and 2 sentinels, 
+                // just fill in this block
+                else
+                {
+                    pointer p = reinterpret_cast<pointer>(&a[bytes_read + sizeof(int)]);
+
+                    // Take the block out of its size class
+                    remove_free(bytes_read);
+
+                    // Mark current pair of sentinels as "used"
+                    (*this)[bytes_read] *= -1;
+                    (*this)[bytes_read + current_sentinel + sizeof(int)] *= -1;
+                    counted_allocate(current_sentinel, current_sentinel);
+
+                    checked(bytes_read);
+                    return p;
+                }
+            }
+
+            // Return null pointer if this block was not suitable
+            return nullptr;
+        }
+
+        // -------
+        // payload
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The payload size of a busy block holding bytes: bytes, at least
+         * min_payload, rounded up so that the block with its sentinels is a
+         * multiple of alignof(T) and the block after it starts aligned too.
+         * Only Ts aligned to more than 2 * sizeof(int) are ever rounded.
+         */
+        static int payload (std::size_t bytes)
+        {
+            if (bytes < min_payload)
+            {
+                bytes = min_payload;
+            }
+            return static_cast<int>(allocator_round_up(bytes + 2 * sizeof(int), alignof(T)) -
+                                    2 * sizeof(int));
+        }
+
+        // ------
+        // resize
+        // ------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The block whose payload p points to, unchecked
+         * @param p a pointer into a[]
+         * @return the offset of the block's beginning sentinel
+         */
+        int block_of (const_pointer p) const
+        {
+            return static_cast<int>(reinterpret_cast<const char*>(p) - a - sizeof(int));
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The block whose payload p points to
+         * throw an invalid_argument exception, if p is not the payload of a
+         * busy block
+         * @param p a pointer returned by allocate
+         * @return the offset of the block's beginning sentinel
+         */
+        int busy_block (const_pointer p) const
+        {
+            const char* c = reinterpret_cast<const char*>(p);
+            if (p == nullptr || !owns(c - sizeof(int)))
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            int block = block_of(p);
+            int size  = -(*this)[block];
+            if (size <= 0 || block + size + 2 * sizeof(int) > static_cast<size_t>(frontier) ||
+                (*this)[block + sizeof(int) + size] != -size)
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            return block;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Makes the size bytes of payload at block into one busy block that
+         * holds bytes_needed, splitting the rest off into a free block if it
+         * can hold a T, as allocate does
+         * @param block the offset of the beginning sentinel
+         * @param size the payload size available, sentinels excluded
+         * @param bytes_needed the payload size the busy block must hold
+         * @return the payload size of the busy block
+         */
+        int place (int block, int size, int bytes_needed)
+        {
+            int remaining = size - bytes_needed;
+            if (remaining < static_cast<int>(min_block))
+            {
+                (*this)[block]                      = -size;
+                (*this)[block + sizeof(int) + size] = -size;
+                return size;
+            }
+            (*this)[block]                              = -bytes_needed;
+            (*this)[block + sizeof(int) + bytes_needed] = -bytes_needed;
+
+            int rest = block + 2 * sizeof(int) + bytes_needed;
+            int rest_size = remaining - 2 * sizeof(int);
+            (*this)[rest]                           = rest_size;
+            (*this)[rest + sizeof(int) + rest_size] = rest_size;
+            insert_free(rest);
+            return bytes_needed;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Allocates bytes_needed from the back of the free block at block,
+         * leaving the front of it free if that can hold a T
+         * @param block the offset of a free block with at least bytes_needed
+         * @param bytes_needed the payload size the busy block must hold
+         * @return the payload of the busy block
+         */
+        pointer allocate_back (int block, int bytes_needed)
+        {
+            int size      = (*this)[block];
+            int remaining = size - bytes_needed;
+            if (remaining < static_cast<int>(min_block))
+            {
+                return allocate_if_possible(block, size, bytes_needed);
+            }
+            remove_free(block);
+            int front = remaining - 2 * sizeof(int);
+            (*this)[block]                       = front;
+            (*this)[block + sizeof(int) + front] = front;
+            insert_free(block);
+
+            int busy = block + remaining;
+            (*this)[busy]                              = -bytes_needed;
+            (*this)[busy + sizeof(int) + bytes_needed] = -bytes_needed;
+            counted_allocate(bytes_needed, bytes_needed + 2 * sizeof(int));
+
+            checked(busy);
+            return reinterpret_cast<pointer>(&a[busy + sizeof(int)]);
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Counts a busy block changing size in place
+         * @param live_delta how much the busy payload grew by
+         * @param free_delta how much the free space grew by
+         */
+        void counted_resize (int live_delta, int free_delta)
+        {
+            #if ALLOCATOR_STATS
+            counters.live_bytes += live_delta;
+            counters.free_bytes += free_delta;
+            if (counters.live_bytes > counters.high_water)
+            {
+                counters.high_water = counters.live_bytes;
+            }
+            #else
+            (void) live_delta;
+            (void) free_delta;
+            #endif
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The free block right after block, if there is one
+         * @return its offset, or -1 if block is last or followed by a busy
+         *         block
+         */
+        int free_after (int block) const
+        {
+            int next = next_block(block);
+            return next != -1 && (*this)[next] > 0 ? next : -1;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The free block right before block, if there is one
+         * @return its offset, or -1 if block is first or preceded by a busy
+         *         block
+         */
+        int free_before (int block) const
+        {
+            if (block == 0 || (*this)[block - sizeof(int)] < 0)
+            {
+                return -1;
+            }
+            return block - (*this)[block - sizeof(int)] - 2 * sizeof(int);
+        }
+
+        // --------
+        // frontier
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The payload a block covering a[frontier, N) would have, or 0
+         */
+        int wilderness () const
+        {
+            return N - frontier < min_block ? 0 :
+                   static_cast<int>(N - frontier - 2 * sizeof(int));
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Moves the frontier up to make a free block of at least bytes,
+         * taking in the free block that ends at the frontier, if any. A
+         * rest too small to form a block later goes into this one.
+         * @param bytes the payload size the block must hold
+         * @return the offset of the free block, in its size class, or -1 if
+         *         there is no room between it and N
+         */
+        int extend (size_t bytes)
+        {
+            int block = frontier;
+            int kept  = 0;
+            int prev  = frontier == 0 ? -1 : free_before(frontier);
+            if (prev != -1)
+            {
+                block = prev;
+                kept  = (*this)[prev];
+            }
+            size_t total = payload(bytes) + 2 * sizeof(int);
+            if (block + total < static_cast<size_t>(frontier))
+            {
+                total = frontier - block;
+            }
+            if (block + total > N)
+            {
+                return -1;
+            }
+            if (N - block - total < min_block)
+            {
+                total = N - block;
+            }
+            int wild = wilderness();
+            if (prev != -1)
+            {
+                remove_free(prev);
+            }
+            int size = total - 2 * sizeof(int);
+            frontier = block + total;
+            (*this)[block]                      = size;
+            (*this)[block + sizeof(int) + size] = size;
+            insert_free(block);
+            counted_resize(0, size - kept - (wild - wilderness()));
+            return block;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time, see the placement policies
+         * Policy::find, once there are blocks for it to look at
+         */
+        int find_block (int bytes_needed)
+        {
+            return frontier == 0 ? -1 : policy.find(*this, bytes_needed);
+        }
+
+        /**
+         * O(1) in space
+         * O(frontier) in time
+         * Makes this a copy of that, writing a[] only below that's frontier
+         */
+        void copy (const Allocator& that)
+        {
+            std::memcpy(a, that.a, that.frontier);
+            std::memcpy(bins, that.bins, sizeof(bins));
+            std::memcpy(sl_bitmap, that.sl_bitmap, sizeof(sl_bitmap));
+            fl_bitmap = that.fl_bitmap;
+            policy    = that.policy;
+            frontier  = that.frontier;
+            #if ALLOCATOR_CHECK >= 2
+            unchecked = that.unchecked;
+            #endif
+            #if ALLOCATOR_STATS
+            counters  = that.counters;
+            #endif
+        }
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * throw a bad_alloc exception, if N is less than min_block
+         */
+        Allocator () :
+            Allocator(allocator_lazy)
+        {
+            size_t sentinels_size = 2 * sizeof(int);
+
+            // Set sentinels
+            (*this)[0] = N - sentinels_size;
+            (*this)[N - sizeof(int)] = N - sentinels_size;
+
+            // The whole of a[] is the only free block
+            frontier = N;
+            insert_free(0);
+            checked(0);
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * An Allocator that writes nothing to a[] until it hands blocks out,
+         * and then only as far as it has to: Allocator<T, N> x(allocator_lazy)
+         * throw a bad_alloc exception, if N is less than min_block
+         */
+        explicit Allocator (allocator_lazy_t)
+        {
+            if (N < min_block)
+            {
+                std::bad_alloc exception;
+                throw exception;
+            }
+
+            // There are no blocks until the first allocate
+            for (int fl = 0; fl < fl_count; ++fl)
+            {
+                for (int sl = 0; sl < sl_count; ++sl)
+                {
+                    bins[fl][sl] = -1;
+                }
+                sl_bitmap[fl] = 0;
+            }
+            fl_bitmap = 0;
+            frontier  = 0;
+
+            #if ALLOCATOR_CHECK >= 2
+            unchecked = 0;
+            #endif
+            #if ALLOCATOR_STATS
+            counters = AllocatorStats();
+            counters.free_bytes = N - 2 * sizeof(int);
+            #endif
+            #if ALLOCATOR_RECORD
+            recorder = nullptr;
+            #endif
+        }
+
+        /**
+         * O(1) in space
+         * O(frontier) in time
+         * Copies the blocks, and nothing past the frontier. The copy is not
+         * recorded.
+         */
+        Allocator (const Allocator& that)
+        {
+            copy(that);
+            #if ALLOCATOR_RECORD
+            recorder = nullptr;
+            #endif
+        }
+
+        /**
+         * O(1) in space
+         * O(frontier) in time
+         */
+        Allocator& operator = (const Allocator& that)
+        {
+            if (this != &that)
+            {
+                copy(that);
+            }
+            return *this;
+        }
+
+        // Default destructor
+        // ~Allocator ();
+
+        // --------
+        // allocate
+        // --------
+
+        FRIEND_TEST(TestAllocate, allocate_1);
+        FRIEND_TEST(TestAllocate, allocate_2);
+        FRIEND_TEST(TestAllocate, allocate_3);
+        FRIEND_TEST(TestAllocate, allocate_4);
+        FRIEND_TEST(TestAllocate, allocate_5);
+        FRIEND_TEST(TestAllocate, allocate_6);
+        FRIEND_TEST(TestAllocate, allocate_7);
+
+        /**
+         * O(1) in space
+         * O(1) in time with GoodFit, see the placement policies
+         * Allocates at least enough space for n T's when requested
+         * After allocation there must be enough space left for a valid block
+         * the smallest allowable block is min_block
+         * choose the block that Policy finds
+         * Throw a bad_alloc exception, if n is invalid
+         */
+        pointer allocate (const size_type& n)
+        {
+            if ((n * sizeof(T)) > N)
+            {
+                std::bad_alloc e;
+                throw e;
+            }
+            if (n == 0)
+            {
+                return nullptr;
+            }
+
+            // Let the policy choose the block
+            size_t bytes_needed = payload(n * sizeof(T));
+            #if ALLOCATOR_STATS
+            ++counters.histogram[allocator_log2(n * sizeof(T))];
+            #endif
+            int block = find_block(bytes_needed);
+            if (block != -1)
+            {
+                return traced_allocate(allocate_if_possible(block, (*this)[block], bytes_needed),
+                                       n * sizeof(T));
+            }
+
+            // Carve a block out of the untouched space past the frontier
+            block = extend(bytes_needed);
+            if (block != -1)
+            {
+                return traced_allocate(allocate_if_possible(block, (*this)[block], bytes_needed),
+                                       n * sizeof(T));
+            }
+
+            // If there is no more space, throw bad_alloc
+            #if ALLOCATOR_STATS
+            ++counters.failures;
+            #endif
+            std::bad_alloc e;
+            throw e;
+
+            return nullptr; // Will never reach here
+        }
+
+        // ----------------
+        // allocate_aligned
+        // ----------------
+
+        /**
+         * O(1) in space
+         * O(1) in time with GoodFit, see the placement policies
+         * Allocates n Ts at an address that is a multiple of alignment, such
+         * as the width of a vector register. The policy is asked for a block
+         * with room for the most padding there can be; the padding in front
+         * of the payload becomes a free block of its own, which coalesces
+         * like any other, so deallocate and reallocate need nothing more.
+         * throw an invalid_argument exception, if alignment is not a power
+         * of two
+         * throw a bad_alloc exception, if there is no room for n Ts and the
+         * padding
+         */
+        pointer allocate_aligned (size_type n, size_type alignment)
+        {
+            if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+            {
+                throw std::invalid_argument("Invalid alignment");
+            }
+            if (alignment <= alignof(T))
+            {
+                return allocate(n);
+            }
+            if (n * sizeof(T) > N || alignment > N)
+            {
+                std::bad_alloc e;
+                throw e;
+            }
+            if (n == 0)
+            {
+                return nullptr;
+            }
+
+            // Padding is either none or a block that can hold a T, so it is
+            // less than that block plus alignment
+            int bytes_needed = payload(n * sizeof(T));
+            int least_pad    = min_block;
+            size_t search    = bytes_needed + least_pad + alignment;
+            #if ALLOCATOR_STATS
+            ++counters.histogram[allocator_log2(n * sizeof(T))];
+            #endif
+            int block = search < N ? find_block(static_cast<int>(search)) : -1;
+            if (block == -1)
+            {
+                block = extend(search);
+            }
+            if (block == -1)
+            {
+                #if ALLOCATOR_STATS
+                ++counters.failures;
+                #endif
+                std::bad_alloc e;
+                throw e;
+            }
+
+            int size  = (*this)[block];
+            int taken = size;
+            remove_free(block);
+            std::uintptr_t address = reinterpret_cast<std::uintptr_t>(&a[block + sizeof(int)]);
+            int pad = static_cast<int>((alignment - address % alignment) % alignment);
+            while (pad != 0 && pad < least_pad)
+            {
+                pad += alignment;
+            }
+            if (pad != 0)
+            {
+                int pad_size = pad - 2 * sizeof(int);
+                (*this)[block]                          = pad_size;
+                (*this)[block + sizeof(int) + pad_size] = pad_size;
+                insert_free(block);
+                taken -= pad_size;
+                block += pad;
+                size  -= pad;
+            }
+            int busy = place(block, size, bytes_needed);
+            if (busy != size)
+            {
+                taken -= size - busy - 2 * sizeof(int);
+            }
+            counted_allocate(busy, taken);
+
+            checked(block);
+            return traced_allocate(reinterpret_cast<pointer>(&a[block + sizeof(int)]),
+                                   n * sizeof(T));
+        }
+
+        // -------------
+        // allocate_near
+        // -------------
+
+        /**
+         * O(1) in space
+         * O(near_distance) in time, plus allocate's when it falls back
+         * Allocates n Ts as close to hint as it can: in the nearest free
+         * block that holds them within near_distance bytes on either side of
+         * hint's block, and failing that wherever allocate puts them. In a
+         * free block after hint the Ts go at its front, and in one before
+         * hint at its back, so they end up next to hint either way. Nodes of
+         * a list or tree allocated near their parents then share cache
+         * lines and pages with them.
+         * throw a bad_alloc exception, if there is no room for n Ts
+         * throw an invalid_argument exception, if hint is invalid
+         * @param n the number of Ts
+         * @param hint a pointer returned by allocate, or nullptr for
+         *        allocate(n)
+         * @return the Ts
+         */
+        pointer allocate_near (size_type n, const_pointer hint)
+        {
+            if (hint == nullptr)
+            {
+                return allocate(n);
+            }
+            int block = busy_block(hint);
+            if (n == 0 || n * sizeof(T) > N)
+            {
+                return allocate(n);
+            }
+
+            // Look at the blocks on both sides in turn, nearest first
+            int bytes_needed = payload(n * sizeof(T));
+            int next         = next_block(block);
+            int after        = next;
+            int before       = prev_block(block);
+            while (after != -1 || before != -1)
+            {
+                if (after != -1 && after - next > near_distance)
+                {
+                    after = -1;
+                }
+                if (before != -1 && block - before > near_distance)
+                {
+                    before = -1;
+                }
+                if (after != -1)
+                {
+                    scanned();
+                    if ((*this)[after] >= bytes_needed)
+                    {
+                        #if ALLOCATOR_STATS
+                        ++counters.histogram[allocator_log2(n * sizeof(T))];
+                        #endif
+                        return traced_allocate(allocate_if_possible(after, (*this)[after], bytes_needed),
+                                               n * sizeof(T));
+                    }
+                    after = next_block(after);
+                }
+                if (before != -1)
+                {
+                    scanned();
+                    if ((*this)[before] >= bytes_needed)
+                    {
+                        #if ALLOCATOR_STATS
+                        ++counters.histogram[allocator_log2(n * sizeof(T))];
+                        #endif
+                        return traced_allocate(allocate_back(before, bytes_needed), n * sizeof(T));
+                    }
+                    before = prev_block(before);
+                }
+            }
+            return allocate(n);
+        }
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void construct (pointer p, const_reference v)
+        {
+            new (p) T(v); // this is correct and exempt
+                          // from the prohibition of new
+        }
+
+        // ----------
+        // deallocate
+        // ----------
+
+        FRIEND_TEST(TestDeallocate, deallocate_1);
+        FRIEND_TEST(TestDeallocate, deallocate_2);
+        FRIEND_TEST(TestDeallocate, deallocate_3);
+        FRIEND_TEST(TestDeallocate, deallocate_4);
+        FRIEND_TEST(TestDeallocate, deallocate_5);
+        FRIEND_TEST(TestDeallocate, deallocate_6);
+        
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Takes in pointer to previously allocated area,
+         * deallocates the area
+         * After deallocation adjacent free blocks must be coalesced
+         * throw an invalid_argument exception, if p is invalid
+         * 
+         */
+        void deallocate (pointer p, size_type n)
+        {
+            if (p == 0)
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+
+            // Get the value of the sentinel of the block that p is pointing to
+            int* sentinel_pointer = reinterpret_cast<int*>(p) - 1;
+            int sentinel_value = *(sentinel_pointer);
+            
+            // Find the beginning of a and the end of its blocks
+            int* beginning_of_a = reinterpret_cast<int*>(&a);
+            int* end_of_a = reinterpret_cast<int*>(&a[frontier]);
+            
+            // Find the last valid location that a sentinel can be at
+            char* end_minus_block = reinterpret_cast<char*>(end_of_a) - 
+                                        (sizeof(int) + sizeof(T));
+            int* last_valid_location = reinterpret_cast<int*>(end_minus_block);
+            
+            // Check for validity before you begin actual deallocation
+            if(sentinel_value > 0 ||
+               reinterpret_cast<int*>(p) < beginning_of_a ||
+               reinterpret_cast<int*>(p) > last_valid_location)
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            
+            // Make sentinel_value positive
+            if(sentinel_value < 0)
+            {
+                sentinel_value *= -1;
+            }
+            int size = sentinel_value;
+            
+            // Mark the "beginning sentinel" in this block
+            int* first_sentinel = sentinel_pointer;
+            char* reader = reinterpret_cast<char*>(first_sentinel);
+
+            // Mark the "end sentinel" in this block
+            char* second_reader = reinterpret_cast<char*>(first_sentinel) +
+                                  sentinel_value + sizeof(int);
+            int* end_sentinel = reinterpret_cast<int*>(second_reader);
+            
+            if (*(end_sentinel) > 0 || (*(end_sentinel) * -1 != sentinel_value))
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            
+            // Check for free blocks BEFORE this block
+            if(first_sentinel - 1 > beginning_of_a)
+            {
+                // Check if previous block is free
+                int previous_sentinel_value = *(reinterpret_cast<int*>(reader - sizeof(int)));
+                if(previous_sentinel_value > 0)
+                {
+
+                    // Set the first_sentinel to the previous block's first sentinel
+                    first_sentinel = reinterpret_cast<int*>(reader - previous_sentinel_value - (2 * sizeof(int)));
+
+                    // The previous block is absorbed, so take it out of its size class
+                    remove_free(reinterpret_cast<char*>(first_sentinel) - a);
+
+                    // Accumulate sentinel value
+                    sentinel_value += previous_sentinel_value + (2 * sizeof(int));
+                }
+            }
+            
+            // Check for free blocks AFTER this block
+            if(end_sentinel + 1 < end_of_a)
+            {
+                // Check if next block is free
+                int next_sentinel_value = *(reinterpret_cast<int*>(second_reader + sizeof(int)));
+
+                if(next_sentinel_value > 0)
+                {
+                    // The next block is absorbed, so take it out of its size class
+                    remove_free(second_reader + sizeof(int) - a);
+
+                    // Set the end_sentinel to the next block's end sentinel
+                    end_sentinel = reinterpret_cast<int*>(second_reader + next_sentinel_value + (2 * sizeof(int)));
+
+                    // Accumulate sentinel value
+                    sentinel_value += next_sentinel_value + (2 * sizeof(int));
+                }
+            }
+
+
+            // Set the values of the new sentinels
+            *(first_sentinel) = sentinel_value;
+            *(end_sentinel) = sentinel_value;
+
+            // Put the coalesced block in its size class
+            int block = reinterpret_cast<char*>(first_sentinel) - a;
+            insert_free(block);
+
+            // Tell the policy about the beginning sentinels that are gone
+            int merges = 0;
+            if (first_sentinel != sentinel_pointer)
+            {
+                policy.merged(reinterpret_cast<char*>(sentinel_pointer) - a, block);
+                ++merges;
+            }
+            if (end_sentinel != reinterpret_cast<int*>(second_reader))
+            {
+                policy.merged(second_reader + sizeof(int) - a, block);
+                ++merges;
+            }
+            counted_deallocate(size, merges);
+            traced_deallocate(p, n * sizeof(T));
+
+            checked(block);
+        }
+
+        // ----------
+        // try_expand
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Grows the block at p in place to hold new_n Ts, taking space from
+         * the free block that follows it. Nothing moves, and on failure
+         * nothing changes.
+         * throw an invalid_argument exception, if p is invalid
+         * @param p a pointer returned by allocate
+         * @param old_n the number of Ts p was allocated with
+         * @param new_n the number of Ts p must hold
+         * @return true if the block at p now holds new_n Ts
+         */
+        bool try_expand (pointer p, size_type old_n, size_type new_n)
+        {
+            int block = busy_block(p);
+            int size  = -(*this)[block];
+            if (new_n * sizeof(T) > N)
+            {
+                return false;
+            }
+            int bytes_needed = payload(new_n * sizeof(T));
+            if (bytes_needed <= size)
+            {
+                traced_resize(p, p, old_n * sizeof(T), new_n * sizeof(T));
+                return true;
+            }
+
+            int next = free_after(block);
+            if (next == -1 || size + (*this)[next] + 2 * static_cast<int>(sizeof(int)) < bytes_needed)
+            {
+                return false;
+            }
+            int next_size = (*this)[next];
+            int total     = size + next_size + 2 * sizeof(int);
+            remove_free(next);
+            int busy = place(block, total, bytes_needed);
+            policy.merged(next, busy == total ? block : block + 2 * sizeof(int) + busy);
+            int free_now = busy == total ? 0 : total - busy - 2 * sizeof(int);
+            counted_resize(busy - size, free_now - next_size);
+            traced_resize(p, p, old_n * sizeof(T), new_n * sizeof(T));
+
+            checked(block);
+            return true;
+        }
+
+        // ----------
+        // try_shrink
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Shrinks the block at p in place to new_n Ts, giving the space after
+         * them back as a free block, coalesced with the free block that
+         * follows if there is one. Space too small to form a block of its
+         * own stays in the busy block.
+         * throw an invalid_argument exception, if p is invalid
+         * @param p a pointer returned by allocate
+         * @param old_n the number of Ts p was allocated with
+         * @param new_n the number of Ts p must still hold, at most old_n
+         * @return true if any space was given back
+         */
+        bool try_shrink (pointer p, size_type old_n, size_type new_n)
+        {
+            int block = busy_block(p);
+            int size  = -(*this)[block];
+            int bytes_needed = payload((new_n == 0 ? 1 : new_n) * sizeof(T));
+            traced_resize(p, p, old_n * sizeof(T), new_n * sizeof(T));
+            if (bytes_needed >= size)
+            {
+                return false;
+            }
+
+            int next      = free_after(block);
+            int next_size = next == -1 ? 0 : (*this)[next];
+            int total     = size;
+            if (next != -1)
+            {
+                remove_free(next);
+                total += next_size + 2 * sizeof(int);
+            }
+            int busy = place(block, total, bytes_needed);
+            int rest = block + 2 * sizeof(int) + busy;
+            if (next != -1)
+            {
+                policy.merged(next, rest);
+            }
+            int free_now = busy == total ? 0 : total - busy - 2 * sizeof(int);
+            counted_resize(busy - size, free_now - next_size);
+
+            checked(block);
+            return busy != size;
+        }
+
+        // ----------
+        // reallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time in place, O(new_n) when the contents move
+         * Resizes the block at p to hold new_n Ts and returns where it now
+         * is, keeping its first min(old_n, new_n) Ts. Like realloc it moves
+         * the contents as bytes, so T must be trivially copyable. In order,
+         * it shrinks or grows the block in place; slides it down into the
+         * free block before it, which may also take in the one after; and
+         * only then allocates a new block, copies, and deallocates p.
+         * A null p is allocate(new_n), and a new_n of 0 is deallocate(p).
+         * throw a bad_alloc exception, if there is no room for new_n Ts, in
+         * which case p is untouched
+         * throw an invalid_argument exception, if p is invalid
+         * @param p a pointer returned by allocate, or nullptr
+         * @param old_n the number of Ts p was allocated with
+         * @param new_n the number of Ts to resize to
+         * @return the block, now holding new_n Ts
+         */
+        pointer reallocate (pointer p, size_type old_n, size_type new_n)
+        {
+            static_assert(std::is_trivially_copyable<T>::value,
+                          "reallocate moves Ts as bytes, so T must be trivially copyable");
+            if (p == nullptr)
+            {
+                return allocate(new_n);
+            }
+            if (new_n == 0)
+            {
+                deallocate(p, old_n);
+                return nullptr;
+            }
+            if (new_n <= old_n)
+            {
+                try_shrink(p, old_n, new_n);
+                return p;
+            }
+            if (try_expand(p, old_n, new_n))
+            {
+                return p;
+            }
+
+            // Slide down into the free block before, and the one after
+            int block        = busy_block(p);
+            int size         = -(*this)[block];
+            int bytes_needed = payload(new_n * sizeof(T));
+            int prev         = free_before(block);
+            int next         = free_after(block);
+            if (prev != -1 && new_n * sizeof(T) <= N)
+            {
+                int prev_size = (*this)[prev];
+                int next_size = next == -1 ? 0 : (*this)[next];
+                int total     = prev_size + size + 2 * sizeof(int);
+                if (next != -1)
+                {
+                    total += next_size + 2 * sizeof(int);
+                }
+                if (total >= bytes_needed)
+                {
+                    remove_free(prev);
+                    if (next != -1)
+                    {
+                        remove_free(next);
+                    }
+                    pointer q = reinterpret_cast<pointer>(&a[prev + sizeof(int)]);
+                    std::memmove(q, p, old_n * sizeof(T) < static_cast<size_t>(size) ? old_n * sizeof(T) : size);
+                    int busy = place(prev, total, bytes_needed);
+                    policy.merged(block, prev);
+                    if (next != -1)
+                    {
+                        policy.merged(next, busy == total ? prev : prev + 2 * sizeof(int) + busy);
+                    }
+                    int free_now = busy == total ? 0 : total - busy - 2 * sizeof(int);
+                    counted_resize(busy - size, free_now - prev_size - next_size);
+                    traced_resize(p, q, old_n * sizeof(T), new_n * sizeof(T));
+
+                    checked(prev);
+                    return q;
+                }
+            }
+
+            // Move
+            pointer q = allocate(new_n);
+            std::memcpy(q, p, old_n * sizeof(T) < static_cast<size_t>(size) ? old_n * sizeof(T) : size);
+            deallocate(p, old_n);
+            return q;
+        }
+
+        // -----
+        // slide
+        // -----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * Moves the block at p down to the start of the free block before
+         * it, if there is one, so that the free space ends up after it,
+         * coalesced with the free block that follows. Like reallocate it
+         * moves the contents as bytes; any other pointer into the block is
+         * left dangling.
+         * throw an invalid_argument exception, if p is invalid
+         * @param p a pointer returned by allocate
+         * @param n the number of Ts p was allocated with
+         * @return where the block now is, p if it did not move
+         */
+        pointer slide (pointer p, size_type n)
+        {
+            static_assert(std::is_trivially_copyable<T>::value,
+                          "slide moves Ts as bytes, so T must be trivially copyable");
+            int block = busy_block(p);
+            int size  = -(*this)[block];
+            int prev  = free_before(block);
+            if (prev == -1)
+            {
+                return p;
+            }
+            int next      = free_after(block);
+            int prev_size = (*this)[prev];
+            int next_size = next == -1 ? 0 : (*this)[next];
+            int total     = prev_size + size + 2 * sizeof(int);
+            remove_free(prev);
+            if (next != -1)
+            {
+                remove_free(next);
+                total += next_size + 2 * sizeof(int);
+            }
+            pointer q = reinterpret_cast<pointer>(&a[prev + sizeof(int)]);
+            std::memmove(q, p, n * sizeof(T) < static_cast<size_t>(size) ? n * sizeof(T) : size);
+            int busy = place(prev, total, size);
+            int rest = prev + 2 * sizeof(int) + busy;
+            policy.merged(block, prev);
+            if (next != -1)
+            {
+                policy.merged(next, rest);
+            }
+            int free_now = busy == total ? 0 : total - busy - 2 * sizeof(int);
+            counted_resize(busy - size, free_now - prev_size - next_size);
+            traced_resize(p, q, n * sizeof(T), n * sizeof(T));
+
+            checked(prev);
+            return q;
+        }
+
+        // -------------
+        // allocate_bulk
+        // -------------
+
+        /**
+         * O(1) in space
+         * O(count) in time, plus one placement per free block used
+         * Allocates count blocks of n_each Ts into out. The blocks are carved
+         * one after another out of the free block the policy finds, asking
+         * first for one that holds the whole batch, so a batch usually costs
+         * one placement and comes back contiguous and in address order.
+         * throw a bad_alloc exception, if the batch does not fit, in which
+         * case nothing is allocated
+         * @param n_each the number of Ts in every block
+         * @param count the number of blocks
+         * @param out where the count pointers are written
+         */
+        void allocate_bulk (size_type n_each, size_type count, pointer* out)
+        {
+            if (n_each * sizeof(T) > N)
+            {
+                std::bad_alloc e;
+                throw e;
+            }
+            if (n_each == 0)
+            {
+                std::fill(out, out + count, nullptr);
+                return;
+            }
+
+            int bytes_needed = payload(n_each * sizeof(T));
+            int stride       = bytes_needed + 2 * sizeof(int);
+            #if ALLOCATOR_STATS
+            counters.histogram[allocator_log2(n_each * sizeof(T))] += count;
+            #endif
+            size_type done = 0;
+            try
+            {
+                while (done != count)
+                {
+                    size_type left  = count - done;
+                    size_t    batch = left * stride - 2 * sizeof(int);
+                    int block = batch < N ? find_block(static_cast<int>(batch)) : -1;
+                    if (block == -1)
+                    {
+                        block = extend(batch);
+                    }
+                    if (block == -1)
+                    {
+                        block = find_block(bytes_needed);
+                    }
+                    if (block == -1)
+                    {
+                        // Let allocate extend by one block, or throw
+                        #if ALLOCATOR_STATS
+                        --counters.histogram[allocator_log2(n_each * sizeof(T))];
+                        #endif
+                        pointer p = allocate(n_each);
+                        out[done++] = p;
+                        continue;
+                    }
+
+                    // Carve as many blocks as fit; the last one takes what
+                    // allocate would leave it
+                    int size = (*this)[block];
+                    size_type fit = (size + 2 * sizeof(int)) / stride;
+                    size_type k   = fit < left ? fit : left;
+                    remove_free(block);
+                    for (size_type i = 1; i != k; ++i)
+                    {
+                        (*this)[block]                              = -bytes_needed;
+                        (*this)[block + sizeof(int) + bytes_needed] = -bytes_needed;
+                        out[done++] = traced_allocate(reinterpret_cast<pointer>(&a[block + sizeof(int)]),
+                                                      n_each * sizeof(T));
+                        counted_allocate(bytes_needed, stride);
+                        block += stride;
+                        size  -= stride;
+                    }
+                    int busy = place(block, size, bytes_needed);
+                    out[done++] = traced_allocate(reinterpret_cast<pointer>(&a[block + sizeof(int)]),
+                                                  n_each * sizeof(T));
+                    counted_allocate(busy, busy == size ? size : busy + 2 * sizeof(int));
+                    checked(block);
+                }
+            }
+            catch (std::bad_alloc&)
+            {
+                deallocate_bulk(out, done, n_each);
+                throw;
+            }
+        }
+
+        // ---------------
+        // deallocate_bulk
+        // ---------------
+
+        /**
+         * O(1) in space
+         * O(count log(count)) in time
+         * Deallocates count blocks of n_each Ts at once. The pointers are
+         * sorted by address, and every run of blocks that are next to each
+         * other in a[] becomes one free block, coalesced with its free
+         * neighbours and put in its size class once.
+         * throw an invalid_argument exception, if any pointer is invalid or
+         * repeated, in which case nothing is deallocated
+         * @param ptrs pointers returned by allocate, reordered by the call
+         * @param count the number of pointers
+         * @param n_each the number of Ts every block was allocated with
+         */
+        void deallocate_bulk (pointer* ptrs, size_type count, size_type n_each)
+        {
+            std::sort(ptrs, ptrs + count, std::less<pointer>());
+            for (size_type i = 0; i != count; ++i)
+            {
+                busy_block(ptrs[i]);
+                if (i != 0 && ptrs[i] == ptrs[i - 1])
+                {
+                    throw std::invalid_argument("Invalid p pointer");
+                }
+            }
+
+            size_type i = 0;
+            while (i != count)
+            {
+                // Find the run that starts at ptrs[i]
+                int first = block_of(ptrs[i]);
+                int last  = first;
+                size_type j = i + 1;
+                while (j != count && block_of(ptrs[j]) == next_block(last))
+                {
+                    last = block_of(ptrs[j]);
+                    ++j;
+                }
+
+                int begin = first;
+                int end   = last + 2 * sizeof(int) - (*this)[last];
+                int prev  = free_before(first);
+                int next  = free_after(last);
+                if (prev != -1)
+                {
+                    remove_free(prev);
+                    begin = prev;
+                }
+                if (next != -1)
+                {
+                    remove_free(next);
+                    end = next + 2 * sizeof(int) + (*this)[next];
+                }
+
+                // Tell the policy and the counters about every block in the
+                // run, then write the coalesced block's sentinels
+                for (size_type k = i; k != j; ++k)
+                {
+                    int block = block_of(ptrs[k]);
+                    if (block != begin)
+                    {
+                        policy.merged(block, begin);
+                    }
+                    counted_deallocate(-(*this)[block],
+                                       k == i ? (prev != -1) + (next != -1) : 1);
+                    traced_deallocate(ptrs[k], n_each * sizeof(T));
+                }
+                if (next != -1)
+                {
+                    policy.merged(next, begin);
+                }
+                int size = end - begin - 2 * sizeof(int);
+                (*this)[begin]                      = size;
+                (*this)[begin + sizeof(int) + size] = size;
+                insert_free(begin);
+
+                checked(begin);
+                i = j;
+            }
+        }
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void destroy (pointer p)
+        {
+            p->~T(); // this is correct
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Read a sentinel from a[], cast value to an int as a[] is a char
+         * array, and dereference it
+         * Returns a read only reference so it can be used safely as a public
+         * method
+         */
+        const int& operator [] (int i) const
+        {
+            return *reinterpret_cast<const int*>(&a[i]);
+        }
+
+        // ----
+        // owns
+        // ----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Whether p points into a[], i.e. could have come from this allocator
+         * @param p any pointer
+         */
+        bool owns (const void* p) const
+        {
+            const char* c = static_cast<const char*>(p);
+            std::less<const char*> less;
+            return !less(c, a) && less(c, a + N);
+        }
+
+        // -----
+        // check
+        // -----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * On-demand full sweep of the heap, whatever ALLOCATOR_CHECK is
+         * @return a bool value representing whether or not a[] is a valid heap
+         */
+        bool check () const
+        {
+            return valid();
+        }
+
+        #if ALLOCATOR_RECORD
+        // ------
+        // record
+        // ------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Records every operation from now on into r, or stops recording if
+         * r is nullptr. Offsets are only unique within one heap, so heaps
+         * should not share a recorder; blocks allocated before recording
+         * started show up as deallocates that replays drop.
+         * @param r the recorder, which must outlive the recording
+         */
+        void record (trace_recorder* r)
+        {
+            recorder = r;
+        }
+        #endif
+
+        #if ALLOCATOR_STATS
+        // -----
+        // stats
+        // -----
+
+        /**
+         * O(1) in space
+         * O(f) in time, where f is the number of blocks in the largest size
+         * class
+         * A snapshot of the counters, with the largest free block filled in;
+         * stats().write_json(out) dumps it
+         */
+        FRIEND_TEST(TestStats, stats_1);
+        FRIEND_TEST(TestStats, stats_2);
+        FRIEND_TEST(TestStats, stats_3);
+        AllocatorStats stats () const
+        {
+            AllocatorStats s = counters;
+            s.largest_free = 0;
+            if (fl_bitmap != 0)
+            {
+                int fl = 31 - __builtin_clz(fl_bitmap);
+                int sl = 31 - __builtin_clz(sl_bitmap[fl]);
+                for (int block = bins[fl][sl]; block != -1; block = next_free(block))
+                {
+                    if (static_cast<std::size_t>((*this)[block]) > s.largest_free)
+                    {
+                        s.largest_free = (*this)[block];
+                    }
+                }
+            }
+            if (static_cast<std::size_t>(wilderness()) > s.largest_free)
+            {
+                s.largest_free = wilderness();
+            }
+            return s;
+        }
+        #endif
+    };
+
+// ---------------------
+// Allocator<T, N, Slab>
+// ---------------------
+
+/**
+ * A slab of N bytes cut into slots of one T each, for heaps that only ever
+ * allocate(1), such as the nodes of a std::list or a std::map, which reach
+ * it through an ArenaAllocator with T an allocator_node. a[] starts
+ * with a bitmap of one bit per slot, set while the slot is busy, followed by
+ * the slots, so there is no header in front of a slot. Free slots form a
+ * stack linked through their first int; the slots from frontier on have
+ * never been handed out and are not on it, which lets construction leave
+ * them untouched.
+ */
+template <typename T, std::size_t N>
+class Allocator<T, N, Slab>
+{
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
+        /**
+         * A slot can only go back to the slab it came from
+         */
+        friend bool operator == (const Allocator& lhs, const Allocator& rhs)
+        {
+            return &lhs == &rhs;
+        }
+
+        // -----------
+        // operator !=
+        // -----------
+
+        friend bool operator != (const Allocator& lhs, const Allocator& rhs)
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        // ----
+        // data
+        // ----
 
-            if (p != NULL)
-            {
-                return p;
-            }
+        /**
+         * A slot holds a T, or the link of a free slot, aligned for both.
+         * slots is the most that fit after the bitmap, which is padded to
+         * the alignment of the first slot.
+         */
+        static constexpr std::size_t slot_align = alignof(T) > alignof(int) ?
+                                                  alignof(T) : alignof(int);
+        static constexpr std::size_t slot_size  = allocator_round_up(
+                                                  sizeof(T) > sizeof(int) ? sizeof(T) : sizeof(int),
+                                                  slot_align);
+        static constexpr std::size_t slots      = allocator_slots(N, slot_size, slot_align,
+                                                                  N * 8 / (slot_size * 8 + 1));
+        static constexpr std::size_t words      = (slots + 31) / 32;
+        static constexpr std::size_t first_slot = allocator_round_up(words * sizeof(unsigned),
+                                                                     slot_align);
+
+        alignas(slot_align) char a[N];
 
-            // If n Ts cannot be allocated in the first block, move bytes_read
-            // to the next pair of sentinels
-            bytes_read += bytes_to_next_sentinel (current_sentinel) + sizeof(int);
+        /**
+         * The index of the free slot on top of the stack, or -1
+         */
+        int free_head;
 
-            // Then, check the rest of the sentinels for possible allocation
-            while (bytes_read < N)
-            {
-                current_sentinel = (*this)[bytes_read];
-                pointer p = allocate_if_possible(bytes_read, current_sentinel, bytes_needed, n);
-                
-                if (p != NULL)
-                {
-                    return p;
-                }
+        /**
+         * The slots below frontier have been handed out at least once
+         */
+        std::size_t frontier;
 
-                // If n Ts cannot be allocated in the first block, move
-                // bytes_read to the next pair of sentinels
-                bytes_read += bytes_to_next_sentinel (current_sentinel) + sizeof(int);
-            }
+        /**
+         * The number of busy slots
+         */
+        std::size_t live;
 
-            // If there is no more space, throw bad_alloc
-            std::bad_alloc e;
-            throw e;
+        #if ALLOCATOR_CHECK >= 2
+        /**
+         * Number of operations since the last full sweep
+         */
+        std::size_t unchecked;
+        #endif
 
-            assert(valid());
-            return nullptr; // Will never reach here
+        #if ALLOCATOR_STATS
+        mutable AllocatorStats counters;
+        #endif
+
+        // -----
+        // slots
+        // -----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Whether slot i is busy
+         */
+        bool busy (std::size_t i) const
+        {
+            return (reinterpret_cast<const unsigned*>(a)[i / 32] >> (i % 32) & 1) != 0;
         }
 
-        // ---------
-        // construct
-        // ---------
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Marks slot i busy if it was free, and free if it was busy
+         */
+        void flip (std::size_t i)
+        {
+            reinterpret_cast<unsigned*>(a)[i / 32] ^= 1u << (i % 32);
+        }
 
         /**
          * O(1) in space
          * O(1) in time
+         * The index of the free slot below slot i on the stack, or -1
          */
-        void construct (pointer p, const_reference v)
+        int& next_free (std::size_t i)
         {
-            new (p) T(v);    // this is correct and exempt
-            assert(valid()); // from the prohibition of new
+            return *reinterpret_cast<int*>(a + first_slot + i * slot_size);
         }
 
-        // ----------
-        // deallocate
-        // ----------
+        int next_free (std::size_t i) const
+        {
+            return *reinterpret_cast<const int*>(a + first_slot + i * slot_size);
+        }
 
-        FRIEND_TEST(TestDeallocate, deallocate_1);
-        FRIEND_TEST(TestDeallocate, deallocate_2);
-        FRIEND_TEST(TestDeallocate, deallocate_3);
-        FRIEND_TEST(TestDeallocate, deallocate_4);
-        FRIEND_TEST(TestDeallocate, deallocate_5);
-        FRIEND_TEST(TestDeallocate, deallocate_6);
-        
         /**
          * O(1) in space
          * O(1) in time
-         * Takes in pointer to previously allocated area,
-         * deallocates the area
-         * After deallocation adjacent free blocks must be coalesced
-         * throw an invalid_argument exception, if p is invalid
-         * 
+         * The index of the slot that starts at p
+         * @return the index, or -1 if p is not the start of a slot
          */
-        void deallocate (pointer p, size_type)
+        std::ptrdiff_t slot_of (const_pointer p) const
         {
-            if (p == 0)
+            if (!owns(p))
             {
-                throw std::invalid_argument("Invalid p pointer");
+                return -1;
+            }
+            std::ptrdiff_t offset = reinterpret_cast<const char*>(p) - (a + first_slot);
+            if (offset < 0 || static_cast<std::size_t>(offset) % slot_size != 0 ||
+                static_cast<std::size_t>(offset) / slot_size >= slots)
+            {
+                return -1;
             }
+            return offset / slot_size;
+        }
 
-            // Get the value of the sentinel of the block that p is pointing to
-            int* sentinel_pointer = reinterpret_cast<int*>(p) - 1;
-            int sentinel_value = *(sentinel_pointer);
-            
-            // Find the beginning and end of a
-            int* beginning_of_a = reinterpret_cast<int*>(&a);
-            int* end_of_a = reinterpret_cast<int*>(&a[sizeof(a) / sizeof(a[0])]);
-            
-            // Find the last valid location that a sentinel can be at
-            char* end_minus_block = reinterpret_cast<char*>(end_of_a) - 
-                                        (2 * sizeof(int) - sizeof(T));
-            int* last_valid_location = reinterpret_cast<int*>(end_minus_block);
-            
-            // Check for validity before you begin actual deallocation
-            if(sentinel_value > 0 ||
-               reinterpret_cast<int*>(p) < beginning_of_a ||
-               reinterpret_cast<int*>(p) > last_valid_location)
+        // -----
+        // valid
+        // -----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * Every busy bit is below frontier and counted in live, and the free
+         * stack holds exactly the other slots below frontier
+         * @return a bool value representing whether or not a[] is a valid slab
+         */
+        bool valid () const
+        {
+            if (frontier > slots || live > frontier)
             {
-                throw std::invalid_argument("Invalid p pointer");
+                return false;
             }
-            
-            // Make sentinel_value positive
-            if(sentinel_value < 0)
+            std::size_t busy_slots = 0;
+            for (std::size_t i = 0; i != slots; ++i)
             {
-                sentinel_value *= -1;
+                if (busy(i))
+                {
+                    if (i >= frontier)
+                    {
+                        return false;
+                    }
+                    ++busy_slots;
+                }
             }
-            
-            // Mark the "beginning sentinel" in this block
-            int* first_sentinel = sentinel_pointer;
-            char* reader = reinterpret_cast<char*>(first_sentinel);
-
-            // Mark the "end sentinel" in this block
-            char* second_reader = reinterpret_cast<char*>(first_sentinel) +
-                                  sentinel_value + sizeof(int);
-            int* end_sentinel = reinterpret_cast<int*>(second_reader);
-            
-            if (*(end_sentinel) > 0 || (*(end_sentinel) * -1 != sentinel_value))
+            if (busy_slots != live)
             {
-                throw std::invalid_argument("Invalid p pointer");
+                return false;
             }
-            
-            // Check for free blocks BEFORE this block
-            if(first_sentinel - 1 > beginning_of_a)
+            std::size_t free_slots = 0;
+            for (int i = free_head; i != -1; i = next_free(i))
             {
-                // Check if previous block is free
-                int previous_sentinel_value = *(reinterpret_cast<int*>(reader - sizeof(int)));
-                if(previous_sentinel_value > 0)
+                if (i < 0 || static_cast<std::size_t>(i) >= frontier || busy(i) ||
+                    ++free_slots > frontier - live)
                 {
+                    return false;
+                }
+            }
+            return free_slots == frontier - live;
+        }
 
-                    // Set the first_sentinel to the previous block's first sentinel
-                    first_sentinel = reinterpret_cast<int*>(reader - previous_sentinel_value - (2 * sizeof(int)));
+        /**
+         * O(1) in space
+         * O(1) in time, O(n) when a full sweep is due
+         * Checks the slab after an operation, as much as ALLOCATOR_CHECK asks
+         * for, and aborts if it is not valid. The local check is of the top
+         * of the free stack, whose link is what a write to a freed slot
+         * overwrites.
+         */
+        void checked ()
+        {
+            #if ALLOCATOR_CHECK >= 1
+            if (free_head != -1 && (free_head < 0 || static_cast<std::size_t>(free_head) >= frontier ||
+                                    busy(free_head)))
+            {
+                corrupt();
+            }
+            #endif
 
-                    // Accumulate sentinel value
-                    sentinel_value += previous_sentinel_value + (2 * sizeof(int));
+            #if ALLOCATOR_CHECK >= 2
+            if (++unchecked == ALLOCATOR_CHECK_PERIOD)
+            {
+                unchecked = 0;
+                if (!valid())
+                {
+                    corrupt();
                 }
             }
-            
-            // Check for free blocks AFTER this block
-            if(end_sentinel + 1 < end_of_a)
+            #endif
+        }
+
+        /**
+         * Reports a failed check and aborts
+         */
+        void corrupt () const
+        {
+            std::fprintf(stderr, "Allocator: slab at %p is corrupt\n",
+                         static_cast<const void*>(a));
+            std::abort();
+        }
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(n / 32) in time, to clear the bitmap
+         * throw a bad_alloc exception, if N cannot hold one slot
+         */
+        Allocator () :
+            free_head(-1),
+            frontier(0),
+            live(0)
+        {
+            if (slots == 0)
             {
-                // Check if next block is free
-                int next_sentinel_value = *(reinterpret_cast<int*>(second_reader + sizeof(int)));
+                std::bad_alloc exception;
+                throw exception;
+            }
+            std::memset(a, 0, words * sizeof(unsigned));
+
+            #if ALLOCATOR_CHECK >= 2
+            unchecked = 0;
+            #endif
+            #if ALLOCATOR_STATS
+            counters = AllocatorStats();
+            counters.free_bytes = slots * sizeof(T);
+            #endif
+        }
 
-                if(next_sentinel_value > 0)
-                {
-                    // Set the end_sentinel to the next block's end sentinel
-                    end_sentinel = reinterpret_cast<int*>(second_reader + next_sentinel_value + (2 * sizeof(int)));
+        // Default copy, destructor, and copy assignment
 
-                    // Accumulate sentinel value
-                    sentinel_value += next_sentinel_value + (2 * sizeof(int));
-                }
+        // --------
+        // capacity
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The number of Ts the slab holds
+         */
+        static constexpr std::size_t capacity ()
+        {
+            return slots;
+        }
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Pops a slot off the free stack, or takes the one at frontier
+         * throw a bad_alloc exception, if n is more than 1 or every slot is
+         * busy
+         */
+        pointer allocate (const size_type& n)
+        {
+            if (n == 0)
+            {
+                return nullptr;
+            }
+            if (n != 1 || (free_head == -1 && frontier == slots))
+            {
+                #if ALLOCATOR_STATS
+                ++counters.failures;
+                #endif
+                std::bad_alloc e;
+                throw e;
+            }
+
+            std::size_t i;
+            if (free_head != -1)
+            {
+                i = free_head;
+                free_head = next_free(i);
+            }
+            else
+            {
+                i = frontier++;
+            }
+            flip(i);
+            ++live;
+
+            #if ALLOCATOR_STATS
+            ++counters.histogram[allocator_log2(sizeof(T))];
+            ++counters.allocations;
+            counters.live_bytes += sizeof(T);
+            counters.free_bytes -= sizeof(T);
+            if (counters.live_bytes > counters.high_water)
+            {
+                counters.high_water = counters.live_bytes;
             }
+            #endif
+            checked();
+            return reinterpret_cast<pointer>(a + first_slot + i * slot_size);
+        }
 
+        // ---------
+        // construct
+        // ---------
 
-            // Set the values of the new sentinels
-            *(first_sentinel) = sentinel_value;
-            *(end_sentinel) = sentinel_value;
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void construct (pointer p, const_reference v)
+        {
+            new (p) T(v); // this is correct and exempt
+                          // from the prohibition of new
+        }
+
+        // ----------
+        // deallocate
+        // ----------
 
-            assert(valid());
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Pushes the slot at p onto the free stack
+         * throw an invalid_argument exception, if p is not a busy slot
+         */
+        void deallocate (pointer p, size_type)
+        {
+            std::ptrdiff_t i = p == nullptr ? -1 : slot_of(p);
+            if (i == -1 || !busy(i))
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            flip(i);
+            --live;
+            next_free(i) = free_head;
+            free_head = static_cast<int>(i);
+
+            #if ALLOCATOR_STATS
+            ++counters.deallocations;
+            counters.live_bytes -= sizeof(T);
+            counters.free_bytes += sizeof(T);
+            #endif
+            checked();
         }
 
         // -------
@@ -498,21 +3053,59 @@ class Allocator
         void destroy (pointer p)
         {
             p->~T(); // this is correct
-            assert(valid());
         }
 
+        // ----
+        // owns
+        // ----
+
         /**
          * O(1) in space
          * O(1) in time
-         * Read a sentinel from a[], cast value to an int as a[] is a char
-         * array, and dereference it
-         * Returns a read only reference so it can be used safely as a public
-         * method
+         * Whether p points into a[], i.e. could have come from this allocator
+         * @param p any pointer
          */
-        const int& operator [] (int i) const
+        bool owns (const void* p) const
         {
-            return *reinterpret_cast<const int*>(&a[i]);
+            const char* c = static_cast<const char*>(p);
+            std::less<const char*> less;
+            return !less(c, a) && less(c, a + N);
+        }
+
+        // -----
+        // check
+        // -----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * On-demand full sweep of the slab, whatever ALLOCATOR_CHECK is
+         * @return a bool value representing whether or not a[] is a valid slab
+         */
+        bool check () const
+        {
+            return valid();
+        }
+
+        #if ALLOCATOR_STATS
+        // -----
+        // stats
+        // -----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * A snapshot of the counters. Any free slot can take any request,
+         * so none of the free space counts as fragmented and largest_free
+         * is all of it.
+         */
+        AllocatorStats stats () const
+        {
+            AllocatorStats s = counters;
+            s.largest_free = s.free_bytes;
+            return s;
         }
+        #endif
     };
 
 #endif // Allocator_h
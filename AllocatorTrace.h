@@ -0,0 +1,333 @@
+/** @file AllocatorTrace.h
+ * @brief Contains the binary format of allocation traces
+ */
+
+// -----------------------------------
+// projects/allocator/AllocatorTrace.h
+// -----------------------------------
+
+#ifndef AllocatorTrace_h
+#define AllocatorTrace_h
+
+// --------
+// includes
+// --------
+
+#include <atomic>    // atomic, atomic_flag, memory_order
+#include <chrono>    // steady_clock
+#include <cstddef>   // size_t
+#include <cstdint>   // int64_t, uint8_t, uint16_t, uint32_t, uint64_t
+#include <cstdio>    // fclose, fopen, fread, fwrite
+#include <memory>    // unique_ptr
+#include <stdexcept> // invalid_argument, runtime_error
+#include <string>    // string
+#include <vector>    // vector
+
+// ------------
+// trace_record
+// ------------
+
+/**
+ * A trace file is trace_magic followed by trace_record structs, in host byte
+ * order, until the end of the file.
+ */
+const std::uint32_t trace_magic = 0x31525441; // "ATR1"
+
+/**
+ * The operations a trace_record can describe
+ */
+enum trace_op
+{
+    trace_allocate   = 0,
+    trace_deallocate = 1
+};
+
+/**
+ * One allocate or deallocate. An allocate and the deallocate of the block
+ * it returned carry the same id; ids may be reused once their block has
+ * been deallocated.
+ */
+struct trace_record
+{
+    std::uint64_t time;     // nanoseconds since the trace started, or 0
+    std::uint64_t id;       // identifies the block
+    std::uint32_t bytes;    // bytes requested, repeated on deallocate
+    std::uint16_t thread;   // small id of the calling thread, or 0
+    std::uint8_t  op;       // a trace_op
+    std::uint8_t  reserved; // 0
+};
+
+static_assert(sizeof(trace_record) == 24, "trace_record must be 24 bytes");
+
+// ----------
+// read_trace
+// ----------
+
+/**
+ * O(n) in space
+ * O(n) in time
+ * Reads a whole trace file
+ * throw a runtime_error if path cannot be read or is not a trace file
+ * @param path the file to read
+ * @return the records of the file, in order
+ */
+inline std::vector<trace_record> read_trace (const std::string& path)
+{
+    std::FILE* f = std::fopen(path.c_str(), "rb");
+    if (f == nullptr)
+    {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    std::uint32_t magic = 0;
+    if (std::fread(&magic, sizeof(magic), 1, f) != 1 || magic != trace_magic)
+    {
+        std::fclose(f);
+        throw std::runtime_error(path + " is not a trace file");
+    }
+
+    std::vector<trace_record> trace;
+    trace_record r;
+    while (std::fread(&r, sizeof(r), 1, f) == 1)
+    {
+        trace.push_back(r);
+    }
+    std::fclose(f);
+    return trace;
+}
+
+// -----------
+// write_trace
+// -----------
+
+/**
+ * O(1) in space
+ * O(n) in time
+ * Writes a whole trace file, replacing path if it exists
+ * throw a runtime_error if path cannot be written
+ * @param path the file to write
+ * @param trace the records to write, in order
+ */
+inline void write_trace (const std::string& path,
+                         const std::vector<trace_record>& trace)
+{
+    std::FILE* f = std::fopen(path.c_str(), "wb");
+    if (f == nullptr)
+    {
+        throw std::runtime_error("cannot open " + path);
+    }
+
+    bool ok = std::fwrite(&trace_magic, sizeof(trace_magic), 1, f) == 1;
+    if (ok && !trace.empty())
+    {
+        ok = std::fwrite(trace.data(), sizeof(trace_record), trace.size(), f) == trace.size();
+    }
+    if (std::fclose(f) != 0 || !ok)
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+// --------------
+// trace_recorder
+// --------------
+
+/**
+ * Appends trace_records to a trace file as they happen, for Allocator's
+ * ALLOCATOR_RECORD mode. Records go into a ring buffer of capacity slots
+ * that any number of threads may fill at once without a lock: a thread
+ * claims a slot by moving head, fills it, and publishes it by advancing the
+ * slot's sequence number. One thread at a time drains the published slots,
+ * in order, to the file; a thread that finds the ring full drains it itself
+ * and then retries. Times are nanoseconds since the recorder was made, and
+ * threads are numbered in the order they first record.
+ */
+class trace_recorder
+{
+    private:
+        /**
+         * A record and the sequence number that says whose turn the slot
+         * is: its position when free, its position + 1 once published
+         */
+        struct slot
+        {
+            std::atomic<std::uint64_t> sequence;
+            trace_record               record;
+        };
+
+        std::unique_ptr<slot[]>               slots;
+        const std::uint64_t                   mask;
+        std::atomic<std::uint64_t>            head;
+        std::uint64_t                         tail;
+        std::atomic_flag                      draining;
+        std::chrono::steady_clock::time_point start;
+        std::FILE*                            file;
+        bool                                  failed;
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * A small id for the calling thread
+         */
+        static std::uint16_t thread ()
+        {
+            static std::atomic<std::uint16_t> next(0);
+            thread_local std::uint16_t id = next++;
+            return id;
+        }
+
+    public:
+        /**
+         * O(capacity) in space
+         * O(capacity) in time
+         * Creates path, replacing it if it exists, and writes trace_magic
+         * throw an invalid_argument exception, if capacity is not a power
+         * of two
+         * throw a runtime_error if path cannot be written
+         * @param path the trace file to write
+         * @param capacity the number of records the ring buffer holds
+         */
+        explicit trace_recorder (const std::string& path, std::size_t capacity = 1 << 16) :
+            slots(),
+            mask(capacity - 1),
+            head(0),
+            tail(0),
+            start(std::chrono::steady_clock::now()),
+            file(nullptr),
+            failed(false)
+        {
+            if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+            {
+                throw std::invalid_argument("Invalid capacity");
+            }
+            draining.clear();
+            slots.reset(new slot[capacity]);
+            for (std::size_t i = 0; i != capacity; ++i)
+            {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            file = std::fopen(path.c_str(), "wb");
+            if (file == nullptr)
+            {
+                throw std::runtime_error("cannot open " + path);
+            }
+            if (std::fwrite(&trace_magic, sizeof(trace_magic), 1, file) != 1)
+            {
+                std::fclose(file);
+                throw std::runtime_error("cannot write " + path);
+            }
+        }
+
+        trace_recorder (const trace_recorder&) = delete;
+        trace_recorder& operator = (const trace_recorder&) = delete;
+
+        /**
+         * O(capacity) in time
+         * Drains what is left and closes the file; use close() to learn
+         * whether every record was written
+         */
+        ~trace_recorder ()
+        {
+            if (file != nullptr)
+            {
+                flush();
+                std::fclose(file);
+            }
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time, unless the ring is full
+         * Records one operation
+         * @param op a trace_op
+         * @param id identifies the block
+         * @param bytes the bytes requested
+         */
+        void record (trace_op op, std::uint64_t id, std::uint32_t bytes)
+        {
+            std::uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - start).count();
+            trace_record r = {time, id, bytes, thread(), static_cast<std::uint8_t>(op), 0};
+
+            std::uint64_t position = head.load(std::memory_order_relaxed);
+            while (true)
+            {
+                slot& s = slots[position & mask];
+                std::int64_t lag = static_cast<std::int64_t>(
+                                       s.sequence.load(std::memory_order_acquire) - position);
+                if (lag == 0)
+                {
+                    if (head.compare_exchange_weak(position, position + 1,
+                                                   std::memory_order_relaxed))
+                    {
+                        s.record = r;
+                        s.sequence.store(position + 1, std::memory_order_release);
+                        return;
+                    }
+                }
+                else
+                {
+                    // Full if the slot still holds a record from the last lap
+                    if (lag < 0)
+                    {
+                        flush();
+                    }
+                    position = head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * O(1) in space
+         * O(capacity) in time
+         * Writes every published record to the file, unless another thread
+         * is already doing so
+         */
+        void flush ()
+        {
+            if (draining.test_and_set(std::memory_order_acquire))
+            {
+                return;
+            }
+            while (true)
+            {
+                slot& s = slots[tail & mask];
+                if (s.sequence.load(std::memory_order_acquire) != tail + 1)
+                {
+                    break;
+                }
+                if (std::fwrite(&s.record, sizeof(trace_record), 1, file) != 1)
+                {
+                    failed = true;
+                }
+                s.sequence.store(tail + mask + 1, std::memory_order_release);
+                ++tail;
+            }
+            std::fflush(file);
+            draining.clear(std::memory_order_release);
+        }
+
+        /**
+         * O(1) in space
+         * O(capacity) in time
+         * Drains the ring and closes the file, if it is still open. Nothing
+         * may be recorded afterwards.
+         * throw a runtime_error if any record could not be written
+         */
+        void close ()
+        {
+            if (file == nullptr)
+            {
+                return;
+            }
+            flush();
+            bool ok = std::fclose(file) == 0 && !failed;
+            file = nullptr;
+            if (!ok)
+            {
+                throw std::runtime_error("cannot write trace");
+            }
+        }
+};
+
+#endif // AllocatorTrace_h
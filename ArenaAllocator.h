@@ -0,0 +1,254 @@
+/** @file ArenaAllocator.h
+ * @brief Contains a standard allocator that hands out memory from an arena
+ *        shared by every copy and rebinding of it
+ */
+
+// -----------------------------------
+// projects/allocator/ArenaAllocator.h
+// -----------------------------------
+
+#ifndef ArenaAllocator_h
+#define ArenaAllocator_h
+
+// --------
+// includes
+// --------
+
+#include <cstddef>     // ptrdiff_t, size_t
+#include <new>         // new
+#include <type_traits> // false_type, true_type
+#include <utility>     // forward
+
+// --------------
+// ArenaAllocator
+// --------------
+
+/**
+ * A handle to an Arena, such as an Allocator<char, N>, a GrowableAllocator
+ * or a ConcurrentAllocator, that meets the standard's allocator
+ * requirements, so that std::list, std::map and std::unordered_map can keep
+ * their nodes in it. The arena is not owned: it must outlive every
+ * container using it. A handle rebinds to any U and asks the arena for
+ * enough of its own value_type to hold n Us, so one arena serves a
+ * container's nodes, buckets and anything else it allocates. Blocks are
+ * aligned for T through the arena's allocate_aligned, if it has one, and
+ * otherwise only as far as the arena aligns its own.
+ *
+ * An arena with capacity(), such as an Allocator<allocator_node<V, links>,
+ * N, Slab>, has fixed slots: every node is one slot, and a node type that
+ * does not fit or align in a slot is a compile-time error. It suits the
+ * containers that only ever allocate nodes, such as std::list and std::map.
+ *
+ * Two handles are equal when they share an arena, as only then can one
+ * free what the other allocated. Copy and move assignment and swap take
+ * the handle along with the elements, so they stay O(1) and every node is
+ * always freed into the arena it came from.
+ */
+template <typename T, typename Arena>
+class ArenaAllocator
+{
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+        typedef std::true_type  propagate_on_container_copy_assignment;
+        typedef std::true_type  propagate_on_container_move_assignment;
+        typedef std::true_type  propagate_on_container_swap;
+        typedef std::false_type is_always_equal;
+
+        template <typename U>
+        struct rebind
+        {
+            typedef ArenaAllocator<U, Arena> other;
+        };
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
+        template <typename U>
+        friend bool operator == (const ArenaAllocator& lhs, const ArenaAllocator<U, Arena>& rhs)
+        {
+            return &lhs.arena() == &rhs.arena();
+        }
+
+        // -----------
+        // operator !=
+        // -----------
+
+        template <typename U>
+        friend bool operator != (const ArenaAllocator& lhs, const ArenaAllocator<U, Arena>& rhs)
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        // ----
+        // data
+        // ----
+
+        typedef typename Arena::value_type unit;
+
+        Arena* shared;
+
+        // -----
+        // units
+        // -----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The number of the arena's value_type that hold n Ts
+         */
+        static std::size_t units (size_type n)
+        {
+            return (n * sizeof(T) + sizeof(unit) - 1) / sizeof(unit);
+        }
+
+        // ----------
+        // allocation
+        // ----------
+
+        /**
+         * Allocates n units aligned for T from an arena with allocate_aligned
+         */
+        template <typename A>
+        static auto allocate_from (A& a, std::size_t n, int)
+            -> decltype(a.allocate_aligned(n, alignof(T)))
+        {
+            return a.allocate_aligned(n, alignof(T));
+        }
+
+        /**
+         * Allocates n units from a slab, whose slots must each hold a T
+         */
+        template <typename A>
+        static auto allocate_from (A& a, std::size_t n, int)
+            -> decltype(A::capacity(), a.allocate(n))
+        {
+            static_assert(sizeof(T) <= sizeof(unit) && alignof(T) <= alignof(unit),
+                          "a slab arena's slots must hold the Ts allocated from it");
+            return a.allocate(n);
+        }
+
+        /**
+         * Allocates n units from any other arena
+         */
+        template <typename A>
+        static typename A::pointer allocate_from (A& a, std::size_t n, long)
+        {
+            return a.allocate(n);
+        }
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        explicit ArenaAllocator (Arena& a) noexcept :
+            shared(&a)
+        {}
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * A handle to the arena of that, as a container makes when it
+         * rebinds its allocator to its node type
+         */
+        template <typename U>
+        ArenaAllocator (const ArenaAllocator<U, Arena>& that) noexcept :
+            shared(&that.arena())
+        {}
+
+        // Default copy, destructor, and copy assignment
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * Arena::allocate in time
+         * throw a bad_alloc exception, if the arena cannot hold n Ts
+         */
+        pointer allocate (size_type n)
+        {
+            return reinterpret_cast<pointer>(allocate_from(*shared, units(n), 0));
+        }
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        template <typename U, typename... Args>
+        void construct (U* p, Args&&... args)
+        {
+            new (p) U(std::forward<Args>(args)...); // this is correct and exempt
+                                                    // from the prohibition of new
+        }
+
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * Arena::deallocate in time
+         * throw an invalid_argument exception, if the arena finds p invalid
+         */
+        void deallocate (pointer p, size_type n)
+        {
+            shared->deallocate(reinterpret_cast<typename Arena::pointer>(p), units(n));
+        }
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        template <typename U>
+        void destroy (U* p)
+        {
+            p->~U(); // this is correct
+        }
+
+        // -----
+        // arena
+        // -----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The arena this handle allocates from
+         */
+        Arena& arena () const
+        {
+            return *shared;
+        }
+};
+
+#endif // ArenaAllocator_h
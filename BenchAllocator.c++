@@ -0,0 +1,1762 @@
+/** @file BenchAllocator.c++
+ * @brief This file contains benchmarks for Allocator.h
+ *
+ * BenchAllocator                         runs the whole suite, then the
+ *                                        thread scaling runs
+ * BenchAllocator --write workload file   writes a synthetic workload as a
+ *                                        trace file
+ * BenchAllocator file...                 replays trace files
+ */
+
+// -------------------------------------
+// projects/allocator/BenchAllocator.c++
+// -------------------------------------
+
+// --------
+// includes
+// --------
+
+#include <algorithm>     // max, shuffle, sort
+#include <atomic>        // atomic
+#include <chrono>        // steady_clock
+#include <cstdint>       // uintptr_t
+#include <cstdio>        // printf
+#include <cstdlib>       // free, malloc
+#include <cstring>       // memcpy, strcmp
+#include <deque>         // deque
+#include <list>          // list
+#include <map>           // map
+#include <exception>     // exception
+#include <memory>        // allocator, allocator_traits, unique_ptr
+#include <mutex>         // lock_guard, mutex
+#include <new>           // bad_alloc
+#include <random>        // mt19937, uniform_int_distribution
+#include <string>        // string
+#include <thread>        // thread, yield
+#include <utility>       // make_pair, pair
+#include <unordered_map> // unordered_map
+#include <vector>        // vector
+
+#include "Allocator.h"
+#include "AllocatorTrace.h"
+#include "ArenaAllocator.h"
+#include "CompactAllocator.h"
+#include "ConcurrentAllocator.h"
+#include "GrowableAllocator.h"
+
+// ---------
+// constants
+// ---------
+
+/**
+ * Number of operations in every synthetic workload
+ */
+const std::size_t operations = 100000;
+
+/**
+ * Size in bytes of the heap that trace files are replayed into
+ */
+const std::size_t replay_size = 1 << 20;
+
+/**
+ * Most threads in the scaling runs, and the heap each of them works in
+ */
+const std::size_t max_threads = 64;
+const std::size_t thread_heap = 1 << 16;
+
+// ---------
+// workloads
+// ---------
+
+/**
+ * Generates the synthetic workloads as traces. Every workload keeps at most
+ * live blocks alive at a time, so that it can be scaled to the heap.
+ */
+struct generator
+{
+    std::mt19937                               gen;
+    std::uniform_int_distribution<std::size_t> bytes;
+    std::vector<trace_record>                  trace;
+    std::uint64_t                              next_id;
+
+    generator (std::size_t min_bytes, std::size_t max_bytes) :
+        gen(371),
+        bytes(min_bytes, max_bytes),
+        trace(),
+        next_id(0)
+    {}
+
+    std::size_t uniform (std::size_t lo, std::size_t hi)
+    {
+        return std::uniform_int_distribution<std::size_t>(lo, hi)(gen);
+    }
+
+    trace_record allocate ()
+    {
+        trace_record r = {0, next_id++, static_cast<std::uint32_t>(bytes(gen)),
+                          0, trace_allocate, 0};
+        trace.push_back(r);
+        return r;
+    }
+
+    void deallocate (trace_record r)
+    {
+        r.op = trace_deallocate;
+        trace.push_back(r);
+    }
+
+    bool done () const
+    {
+        return trace.size() >= operations;
+    }
+};
+
+/**
+ * Allocates a run of blocks and frees part of it in reverse order
+ */
+std::vector<trace_record> make_lifo (std::size_t live, std::size_t min_bytes,
+                                     std::size_t max_bytes)
+{
+    generator g(min_bytes, max_bytes);
+    std::vector<trace_record> stack;
+    while (!g.done())
+    {
+        for (std::size_t k = g.uniform(1, live - stack.size()); k != 0; --k)
+        {
+            stack.push_back(g.allocate());
+        }
+        for (std::size_t k = g.uniform(1, stack.size()); k != 0; --k)
+        {
+            g.deallocate(stack.back());
+            stack.pop_back();
+        }
+    }
+    return g.trace;
+}
+
+/**
+ * Frees the oldest block once live blocks are alive
+ */
+std::vector<trace_record> make_fifo (std::size_t live, std::size_t min_bytes,
+                                     std::size_t max_bytes)
+{
+    generator g(min_bytes, max_bytes);
+    std::deque<trace_record> queue;
+    while (!g.done())
+    {
+        if (queue.size() == live)
+        {
+            g.deallocate(queue.front());
+            queue.pop_front();
+        }
+        queue.push_back(g.allocate());
+    }
+    return g.trace;
+}
+
+/**
+ * Picks one of live slots at random, and frees its block if it has one or
+ * allocates one into it if it does not
+ */
+std::vector<trace_record> make_random (std::size_t live, std::size_t min_bytes,
+                                       std::size_t max_bytes)
+{
+    generator g(min_bytes, max_bytes);
+    std::vector<trace_record> slots(live);
+    std::vector<bool>         full(live, false);
+    while (!g.done())
+    {
+        std::size_t i = g.uniform(0, live - 1);
+        if (full[i])
+        {
+            g.deallocate(slots[i]);
+        }
+        else
+        {
+            slots[i] = g.allocate();
+        }
+        full[i] = !full[i];
+    }
+    return g.trace;
+}
+
+/**
+ * A producer allocates bursts of blocks into a queue that a consumer frees
+ * in bursts of its own, in order
+ */
+std::vector<trace_record> make_producer_consumer (std::size_t live,
+                                                  std::size_t min_bytes,
+                                                  std::size_t max_bytes)
+{
+    generator g(min_bytes, max_bytes);
+    std::deque<trace_record> queue;
+    while (!g.done())
+    {
+        for (std::size_t k = g.uniform(1, 64); k != 0 && queue.size() != live; --k)
+        {
+            queue.push_back(g.allocate());
+        }
+        for (std::size_t k = g.uniform(1, 64); k != 0 && !queue.empty(); --k)
+        {
+            g.deallocate(queue.front());
+            queue.pop_front();
+        }
+    }
+    return g.trace;
+}
+
+/**
+ * make_random with one large request in every ten
+ */
+std::vector<trace_record> make_mixed (std::size_t live, std::size_t min_bytes,
+                                      std::size_t max_bytes)
+{
+    std::vector<trace_record> trace = make_random(live, min_bytes, max_bytes);
+    std::mt19937 gen(372);
+    std::uniform_int_distribution<std::size_t> pick(1, 10);
+    std::uniform_int_distribution<std::uint32_t> large(32 * max_bytes, 64 * max_bytes);
+    std::unordered_map<std::uint64_t, std::uint32_t> bytes;
+    for (trace_record& r : trace)
+    {
+        if (r.op == trace_allocate && pick(gen) == 1)
+        {
+            r.bytes = large(gen);
+            bytes[r.id] = r.bytes;
+        }
+        else if (r.op == trace_deallocate && bytes.count(r.id) != 0)
+        {
+            r.bytes = bytes[r.id];
+        }
+    }
+    return trace;
+}
+
+struct workload
+{
+    const char* name;
+    std::vector<trace_record> (*make) (std::size_t, std::size_t, std::size_t);
+    std::size_t average_bytes;
+};
+
+const workload workloads[] =
+{
+    {"lifo",     make_lifo,              36},
+    {"fifo",     make_fifo,              36},
+    {"random",   make_random,            36},
+    {"prodcons", make_producer_consumer, 36},
+    {"mixed",    make_mixed,            340}
+};
+
+/**
+ * Builds workload w sized so that its live blocks fill about half of a heap
+ * of heap_size bytes
+ */
+std::vector<trace_record> make_workload (const workload& w, std::size_t heap_size)
+{
+    std::size_t live = heap_size / 2 / (w.average_bytes + 2 * sizeof(int));
+    return w.make(std::max<std::size_t>(live, 2), 8, 64);
+}
+
+// ------
+// replay
+// ------
+
+/**
+ * A trace with its ids replaced by dense slot numbers, so that replaying it
+ * only indexes a vector. Deallocates of blocks the trace never allocated
+ * are dropped.
+ */
+struct compiled_trace
+{
+    struct operation
+    {
+        std::size_t   slot;
+        std::uint32_t bytes;
+        bool          allocate;
+    };
+
+    std::vector<operation> ops;
+    std::size_t            slots;
+
+    explicit compiled_trace (const std::vector<trace_record>& trace) :
+        ops(),
+        slots(0)
+    {
+        std::unordered_map<std::uint64_t, std::size_t> live;
+        std::vector<std::size_t> unused;
+        for (const trace_record& r : trace)
+        {
+            if (r.op == trace_allocate)
+            {
+                std::size_t slot = slots;
+                if (unused.empty())
+                {
+                    ++slots;
+                }
+                else
+                {
+                    slot = unused.back();
+                    unused.pop_back();
+                }
+                live[r.id] = slot;
+                operation op = {slot, r.bytes, true};
+                ops.push_back(op);
+            }
+            else if (live.count(r.id) != 0)
+            {
+                operation op = {live[r.id], r.bytes, false};
+                ops.push_back(op);
+                unused.push_back(live[r.id]);
+                live.erase(r.id);
+            }
+        }
+    }
+};
+
+/**
+ * What replaying a trace measured
+ */
+struct result
+{
+    double      ops_per_second;
+    double      p50;
+    double      p99;
+    double      p999;
+    std::size_t failed;
+    double      peak_fragmentation; // negative if not measurable
+};
+
+/**
+ * O(1) in space
+ * O(n) in time
+ * External fragmentation of a heap: 1 - (largest free block / free bytes),
+ * 0 when all the free space is in one block
+ * @param x the allocator to measure, read through its sentinels
+ */
+template <typename T, std::size_t N, typename P>
+double fragmentation (const Allocator<T, N, P>& x)
+{
+    std::size_t free_bytes = 0;
+    std::size_t largest    = 0;
+    std::size_t i          = 0;
+    while (i < N)
+    {
+        int sentinel = x[i];
+        if (sentinel > 0)
+        {
+            free_bytes += sentinel;
+            largest     = std::max<std::size_t>(largest, sentinel);
+        }
+        i += (sentinel < 0 ? -sentinel : sentinel) + 2 * sizeof(int);
+    }
+    return free_bytes == 0 ? 0 : 1 - static_cast<double>(largest) / free_bytes;
+}
+
+/**
+ * Number of Ts that a request for bytes bytes is replayed as
+ */
+template <typename T>
+std::size_t elements (std::uint32_t bytes)
+{
+    return std::max<std::size_t>(1, (bytes + sizeof(T) - 1) / sizeof(T));
+}
+
+/**
+ * Replays a compiled trace through an allocator. A subject has allocate(n)
+ * returning a pointer, or nullptr on failure, deallocate(p, n), and
+ * fragmentation(), negative if it cannot be measured.
+ */
+template <typename T, typename S>
+class replayer
+{
+    private:
+        S&                       subject;
+        const compiled_trace&    trace;
+        std::vector<T*>          ptrs;
+        std::vector<std::size_t> counts;
+
+        bool step (const compiled_trace::operation& op)
+        {
+            T*& p = ptrs[op.slot];
+            if (!op.allocate)
+            {
+                if (p != nullptr)
+                {
+                    subject.deallocate(p, counts[op.slot]);
+                    p = nullptr;
+                }
+                return true;
+            }
+            counts[op.slot] = elements<T>(op.bytes);
+            p = subject.allocate(counts[op.slot]);
+            return p != nullptr;
+        }
+
+        void release ()
+        {
+            for (std::size_t i = 0; i != ptrs.size(); ++i)
+            {
+                if (ptrs[i] != nullptr)
+                {
+                    subject.deallocate(ptrs[i], counts[i]);
+                    ptrs[i] = nullptr;
+                }
+            }
+        }
+
+    public:
+        replayer (S& s, const compiled_trace& t) :
+            subject(s),
+            trace(t),
+            ptrs(t.slots, nullptr),
+            counts(t.slots, 0)
+        {}
+
+        /**
+         * Replays the trace twice: once untimed per operation for the
+         * throughput, and once timing every operation for the latency
+         * percentiles, which include the cost of reading the clock, while
+         * sampling the fragmentation 64 times
+         */
+        result run ()
+        {
+            typedef std::chrono::steady_clock clock;
+            result r = {0, 0, 0, 0, 0, subject.fragmentation()};
+
+            clock::time_point b = clock::now();
+            for (const compiled_trace::operation& op : trace.ops)
+            {
+                if (!step(op))
+                {
+                    ++r.failed;
+                }
+            }
+            clock::time_point e = clock::now();
+            release();
+            r.ops_per_second = trace.ops.size() /
+                               std::chrono::duration<double>(e - b).count();
+
+            std::vector<double> latency;
+            latency.reserve(trace.ops.size());
+            std::size_t sample = std::max<std::size_t>(1, trace.ops.size() / 64);
+            for (std::size_t i = 0; i != trace.ops.size(); ++i)
+            {
+                clock::time_point b = clock::now();
+                step(trace.ops[i]);
+                clock::time_point e = clock::now();
+                latency.push_back(std::chrono::duration<double, std::nano>(e - b).count());
+                if (i % sample == 0)
+                {
+                    r.peak_fragmentation = std::max(r.peak_fragmentation,
+                                                    subject.fragmentation());
+                }
+            }
+            release();
+
+            if (!latency.empty())
+            {
+                std::sort(latency.begin(), latency.end());
+                r.p50  = latency[latency.size() * 50  / 100];
+                r.p99  = latency[latency.size() * 99  / 100];
+                r.p999 = latency[latency.size() * 999 / 1000];
+            }
+            return r;
+        }
+};
+
+// --------
+// subjects
+// --------
+
+/**
+ * Allocator<T, N, Policy> on the free store, reporting bad_alloc as nullptr
+ */
+template <typename T, std::size_t N, typename Policy = GoodFit>
+struct arena_subject
+{
+    typedef Allocator<T, N, Policy> allocator_type;
+    std::unique_ptr<allocator_type> x;
+
+    arena_subject () :
+        x(new allocator_type())
+    {}
+
+    T* allocate (std::size_t n)
+    {
+        try
+        {
+            return x->allocate(n);
+        }
+        catch (std::bad_alloc&)
+        {
+            return nullptr;
+        }
+    }
+
+    void deallocate (T* p, std::size_t n)
+    {
+        x->deallocate(p, n);
+    }
+
+    double fragmentation () const
+    {
+        return ::fragmentation(*x);
+    }
+};
+
+/**
+ * CompactAllocator<T, N> on the free store, reporting bad_alloc as nullptr
+ */
+template <typename T, std::size_t N>
+struct compact_subject
+{
+    typedef CompactAllocator<T, N> allocator_type;
+    std::unique_ptr<allocator_type> x;
+
+    compact_subject () :
+        x(new allocator_type())
+    {}
+
+    T* allocate (std::size_t n)
+    {
+        try
+        {
+            return x->allocate(n);
+        }
+        catch (std::bad_alloc&)
+        {
+            return nullptr;
+        }
+    }
+
+    void deallocate (T* p, std::size_t n)
+    {
+        x->deallocate(p, n);
+    }
+
+    double fragmentation () const
+    {
+        return -1;
+    }
+};
+
+/**
+ * GrowableAllocator<T> mapping chunks of N bytes, reporting bad_alloc as
+ * nullptr
+ */
+template <typename T, std::size_t N>
+struct growable_subject
+{
+    GrowableAllocator<T> x;
+
+    growable_subject () :
+        x(N)
+    {}
+
+    T* allocate (std::size_t n)
+    {
+        try
+        {
+            return x.allocate(n);
+        }
+        catch (std::bad_alloc&)
+        {
+            return nullptr;
+        }
+    }
+
+    void deallocate (T* p, std::size_t n)
+    {
+        x.deallocate(p, n);
+    }
+
+    double fragmentation () const
+    {
+        return -1;
+    }
+};
+
+/**
+ * std::allocator<T>, a baseline
+ */
+template <typename T>
+struct std_subject
+{
+    std::allocator<T> x;
+
+    T* allocate (std::size_t n)
+    {
+        return x.allocate(n);
+    }
+
+    void deallocate (T* p, std::size_t n)
+    {
+        x.deallocate(p, n);
+    }
+
+    double fragmentation () const
+    {
+        return -1;
+    }
+};
+
+/**
+ * malloc and free, a baseline
+ */
+template <typename T>
+struct malloc_subject
+{
+    T* allocate (std::size_t n)
+    {
+        return static_cast<T*>(std::malloc(n * sizeof(T)));
+    }
+
+    void deallocate (T* p, std::size_t)
+    {
+        std::free(p);
+    }
+
+    double fragmentation () const
+    {
+        return -1;
+    }
+};
+
+// ------
+// report
+// ------
+
+/**
+ * Replays trace through subject s and prints one line for it
+ */
+template <typename T, typename S>
+void report (const char* subject, const char* type, std::size_t heap_size,
+             const char* trace_name, S& s, const compiled_trace& trace)
+{
+    result r = replayer<T, S>(s, trace).run();
+    std::printf("%-10s %-8s %8zu %-10s %8.2f Mops/s %7.0f %7.0f %8.0f ns %7zu",
+                subject, type, heap_size, trace_name, r.ops_per_second / 1e6,
+                r.p50, r.p99, r.p999, r.failed);
+    if (r.peak_fragmentation < 0)
+    {
+        std::printf("       -\n");
+    }
+    else
+    {
+        std::printf(" %6.1f%%\n", 100 * r.peak_fragmentation);
+    }
+}
+
+void header ()
+{
+    std::printf("%-10s %-8s %8s %-10s %15s %7s %7s %11s %7s %7s\n",
+                "subject", "T", "N", "trace", "throughput", "p50", "p99",
+                "p99.9", "failed", "frag");
+}
+
+/**
+ * Every workload on Allocator<T, N> with the baselines next to it
+ */
+template <typename T, std::size_t N>
+void suite (const char* type)
+{
+    for (const workload& w : workloads)
+    {
+        compiled_trace trace(make_workload(w, N));
+
+        arena_subject<T, N> arena;
+        report<T>("Allocator", type, N, w.name, arena, trace);
+
+        compact_subject<T, N> compact;
+        report<T>("Compact", type, N, w.name, compact, trace);
+
+        growable_subject<T, N> growable;
+        report<T>("Growable", type, N, w.name, growable, trace);
+
+        std_subject<T> std_allocator;
+        report<T>("std", type, N, w.name, std_allocator, trace);
+
+        malloc_subject<T> malloc_free;
+        report<T>("malloc", type, N, w.name, malloc_free, trace);
+    }
+}
+
+/**
+ * Every workload on Allocator<int, N, Policy> for each placement policy
+ */
+template <std::size_t N>
+void policies ()
+{
+    for (const workload& w : workloads)
+    {
+        compiled_trace trace(make_workload(w, N));
+
+        arena_subject<int, N, GoodFit>  good;
+        report<int>("GoodFit",  "int", N, w.name, good,  trace);
+        arena_subject<int, N, FirstFit> first;
+        report<int>("FirstFit", "int", N, w.name, first, trace);
+        arena_subject<int, N, NextFit>  next;
+        report<int>("NextFit",  "int", N, w.name, next,  trace);
+        arena_subject<int, N, BestFit>  best;
+        report<int>("BestFit",  "int", N, w.name, best,  trace);
+        arena_subject<int, N, WorstFit> worst;
+        report<int>("WorstFit", "int", N, w.name, worst, trace);
+    }
+}
+
+// ------
+// growth
+// ------
+
+/**
+ * Grows four buffers of ints from 1 to N / 64 ints by doubling, round robin,
+ * allocating a small block after every third growth so that a buffer's
+ * neighbour is sometimes busy. Grows with reallocate if in_place, otherwise
+ * with allocate, copy, and deallocate, as a container would without it.
+ * @param moved set to the number of growths that moved a buffer
+ * @param growths set to the number of growths
+ * @return the growths per second
+ */
+template <std::size_t N>
+double grow (bool in_place, std::size_t& moved, std::size_t& growths)
+{
+    typedef std::chrono::steady_clock clock;
+    typedef Allocator<int, N> allocator_type;
+    std::unique_ptr<allocator_type> x(new allocator_type());
+    const std::size_t buffers = 4;
+    const std::size_t most    = N / sizeof(int) / 64;
+    moved   = 0;
+    growths = 0;
+
+    clock::time_point b = clock::now();
+    for (int round = 0; round != 200; ++round)
+    {
+        int*        p[buffers];
+        std::size_t n[buffers];
+        std::vector<int*> small;
+        for (std::size_t i = 0; i != buffers; ++i)
+        {
+            p[i] = x->allocate(1);
+            n[i] = 1;
+        }
+        for (bool more = true; more; )
+        {
+            more = false;
+            for (std::size_t i = 0; i != buffers; ++i)
+            {
+                if (n[i] >= most)
+                {
+                    continue;
+                }
+                int* q = nullptr;
+                if (in_place)
+                {
+                    q = x->reallocate(p[i], n[i], 2 * n[i]);
+                }
+                else
+                {
+                    q = x->allocate(2 * n[i]);
+                    std::memcpy(q, p[i], n[i] * sizeof(int));
+                    x->deallocate(p[i], n[i]);
+                }
+                moved += q != p[i];
+                ++growths;
+                p[i]  = q;
+                n[i] *= 2;
+                more  = true;
+                if (growths % 3 == 0)
+                {
+                    small.push_back(x->allocate(2));
+                }
+            }
+        }
+        for (std::size_t i = 0; i != buffers; ++i)
+        {
+            x->deallocate(p[i], n[i]);
+        }
+        for (int* q : small)
+        {
+            x->deallocate(q, 2);
+        }
+    }
+    clock::time_point e = clock::now();
+    return growths / std::chrono::duration<double>(e - b).count();
+}
+
+/**
+ * grow with and without reallocate
+ */
+template <std::size_t N>
+void growth ()
+{
+    std::printf("%-16s %8s %15s %7s\n", "growth", "N", "throughput", "moved");
+    for (int in_place = 1; in_place >= 0; --in_place)
+    {
+        std::size_t moved   = 0;
+        std::size_t growths = 0;
+        double rate = grow<N>(in_place != 0, moved, growths);
+        std::printf("%-16s %8zu %8.2f Mops/s %6.1f%%\n",
+                    in_place ? "reallocate" : "allocate+copy", N, rate / 1e6,
+                    100.0 * moved / growths);
+    }
+}
+
+// ----
+// bulk
+// ----
+
+/**
+ * Allocates batches of batch blocks of 4 ints and frees them in shuffled
+ * order, with allocate_bulk and deallocate_bulk if bulk, otherwise one
+ * call per block. Eight batches are live at a time, so frees leave holes
+ * between blocks still in use.
+ * @return the blocks allocated and freed per second
+ */
+template <std::size_t N, typename Policy>
+double batches (std::size_t batch, bool bulk)
+{
+    typedef std::chrono::steady_clock clock;
+    typedef Allocator<int, N, Policy> allocator_type;
+    std::unique_ptr<allocator_type> x(new allocator_type());
+    const std::size_t live  = 8;
+    const std::size_t total = 1 << 20;
+    std::vector<std::vector<int*> > batches(live, std::vector<int*>(batch));
+    std::mt19937 gen(373);
+
+    clock::time_point b = clock::now();
+    for (std::size_t done = 0; done < total; done += batch)
+    {
+        std::vector<int*>& v = batches[(done / batch) % live];
+        if (done >= live * batch)
+        {
+            if (bulk)
+            {
+                x->deallocate_bulk(v.data(), batch, 4);
+            }
+            else
+            {
+                for (int* p : v)
+                {
+                    x->deallocate(p, 4);
+                }
+            }
+        }
+        if (bulk)
+        {
+            x->allocate_bulk(4, batch, v.data());
+        }
+        else
+        {
+            for (int*& p : v)
+            {
+                p = x->allocate(4);
+            }
+        }
+        std::shuffle(v.begin(), v.end(), gen);
+    }
+    clock::time_point e = clock::now();
+    return total / std::chrono::duration<double>(e - b).count();
+}
+
+/**
+ * batches with and without the bulk calls, for GoodFit and FirstFit
+ */
+template <std::size_t N>
+void bulk ()
+{
+    std::printf("%-10s %6s %15s %15s\n", "bulk", "batch", "per block", "bulk");
+    for (std::size_t batch = 64; batch <= 1024; batch *= 4)
+    {
+        std::printf("%-10s %6zu %8.2f Mops/s %8.2f Mops/s\n", "GoodFit", batch,
+                    batches<N, GoodFit>(batch, false) / 1e6,
+                    batches<N, GoodFit>(batch, true)  / 1e6);
+        std::printf("%-10s %6zu %8.2f Mops/s %8.2f Mops/s\n", "FirstFit", batch,
+                    batches<N, FirstFit>(batch, false) / 1e6,
+                    batches<N, FirstFit>(batch, true)  / 1e6);
+    }
+}
+
+// ----
+// lazy
+// ----
+
+/**
+ * O(1) in space
+ * O(1) in time
+ * The resident set size of this process in bytes, or 0 where
+ * /proc/self/statm cannot be read
+ */
+std::size_t resident ()
+{
+    std::FILE* f = std::fopen("/proc/self/statm", "r");
+    if (f == nullptr)
+    {
+        return 0;
+    }
+    unsigned long size  = 0;
+    unsigned long pages = 0;
+    int read = std::fscanf(f, "%lu %lu", &size, &pages);
+    std::fclose(f);
+    return read == 2 ? pages * sysconf(_SC_PAGESIZE) : 0;
+}
+
+/**
+ * Maps a 1 GB chunk and uses 1 MB of it, to show what becomes resident
+ */
+void lazy ()
+{
+    std::size_t before = resident();
+    GrowableAllocator<char> x(std::size_t(1) << 30);
+    std::vector<char*> v;
+    for (int i = 0; i != 1024; ++i)
+    {
+        v.push_back(x.allocate(1000));
+        v.back()[0] = 1;
+    }
+    std::printf("%-10s %6zu MB mapped %6zu MB resident\n", "Growable",
+                x.mapped() >> 20, (resident() - before) >> 20);
+    for (char* p : v)
+    {
+        x.deallocate(p, 1000);
+    }
+}
+
+// -------
+// density
+// -------
+
+/**
+ * A 32 byte object
+ */
+struct record
+{
+    double values[4];
+};
+
+/**
+ * O(1) in space
+ * O(N) in time
+ * How many blocks of n Ts fit in subject s before it is full
+ */
+template <typename T, typename S>
+std::size_t fill (S& s, std::size_t n)
+{
+    std::size_t count = 0;
+    while (s.allocate(n) != nullptr)
+    {
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * Blocks of 1 and of 3 Ts that fit in N bytes with Allocator's layout and
+ * with CompactAllocator's
+ */
+template <typename T, std::size_t N>
+void density (const char* type)
+{
+    for (std::size_t n = 1; n <= 3; n += 2)
+    {
+        arena_subject<T, N>   arena;
+        compact_subject<T, N> compact;
+        std::size_t in_arena   = fill<T>(arena,   n);
+        std::size_t in_compact = fill<T>(compact, n);
+        std::printf("%-8s %8zu %3zu %10zu %6.1f B %10zu %6.1f B %+6.1f%%\n",
+                    type, N, n, in_arena, static_cast<double>(N) / in_arena,
+                    in_compact, static_cast<double>(N) / in_compact,
+                    100.0 * in_compact / in_arena - 100);
+    }
+}
+
+void densities ()
+{
+    std::printf("%-8s %8s %3s %10s %8s %10s %8s %7s  (both aligned for T)\n", "T", "N",
+                "n", "Allocator", "each", "Compact", "each", "more");
+    density<char,   1 << 16>("char");
+    density<int,    1 << 16>("int");
+    density<double, 1 << 16>("double");
+    density<record, 1 << 16>("record");
+}
+
+// -----
+// nodes
+// -----
+
+/**
+ * Keeps live single Ts allocated through subject s and replaces a random
+ * one at a time, as a node-based container does under inserts and erases
+ * @return the deallocate and allocate pairs per second
+ */
+template <typename T, typename S>
+double churn (S& s, std::size_t live)
+{
+    typedef std::chrono::steady_clock clock;
+    const std::size_t total = 1 << 21;
+    std::vector<T*> v(live);
+    for (T*& p : v)
+    {
+        p = s.allocate(1);
+    }
+    std::mt19937 gen(373);
+    std::uniform_int_distribution<std::size_t> pick(0, live - 1);
+    std::vector<std::size_t> order(total);
+    for (std::size_t& i : order)
+    {
+        i = pick(gen);
+    }
+
+    clock::time_point b = clock::now();
+    for (std::size_t i : order)
+    {
+        s.deallocate(v[i], 1);
+        v[i] = s.allocate(1);
+    }
+    clock::time_point e = clock::now();
+    for (T* p : v)
+    {
+        s.deallocate(p, 1);
+    }
+    return total / std::chrono::duration<double>(e - b).count();
+}
+
+/**
+ * churn on Allocator<T, N>, CompactAllocator<T, N>, Allocator<T, N, Slab>
+ * and the baselines, with a sixty-fourth of N live
+ */
+template <typename T, std::size_t N>
+void nodes (const char* type)
+{
+    arena_subject<T, N>       arena;
+    compact_subject<T, N>     compact;
+    arena_subject<T, N, Slab> slab;
+    std_subject<T>            std_allocator;
+    malloc_subject<T>         malloc_free;
+    std::size_t live = N / 64;
+    std::printf("%-8s %8zu %9.2f %9.2f %9.2f %9.2f %9.2f\n", type, live,
+                churn<T>(arena,         live) / 1e6,
+                churn<T>(compact,       live) / 1e6,
+                churn<T>(slab,          live) / 1e6,
+                churn<T>(std_allocator, live) / 1e6,
+                churn<T>(malloc_free,   live) / 1e6);
+}
+
+void nodes ()
+{
+    std::printf("%-8s %8s %9s %9s %9s %9s %9s  (Mops/s)\n", "T", "live",
+                "Allocator", "Compact", "Slab", "std", "malloc");
+    nodes<char,   1 << 20>("char");
+    nodes<int,    1 << 20>("int");
+    nodes<double, 1 << 20>("double");
+    nodes<record, 1 << 20>("record");
+}
+
+// ----------
+// containers
+// ----------
+
+/**
+ * The arena the containers below keep their nodes in
+ */
+typedef Allocator<char, 1 << 26> container_arena;
+
+template <typename A>
+void insert (std::list<int, A>& c, int key)
+{
+    c.push_back(key);
+}
+
+template <typename M>
+void insert (M& c, int key)
+{
+    c.emplace(key, key);
+}
+
+int value (int e)
+{
+    return e;
+}
+
+int value (const std::pair<const int, int>& e)
+{
+    return e.second;
+}
+
+/**
+ * Inserts keys into c, with a malloc of 16 to 256 bytes between every two
+ * inserts standing in for the rest of a program, then walks c repeatedly
+ * @param build set to the nanoseconds per insert
+ * @param walk  set to the nanoseconds per element visited
+ */
+template <typename C>
+void build_and_walk (C& c, const std::vector<int>& keys, double& build, double& walk)
+{
+    typedef std::chrono::steady_clock clock;
+    std::mt19937 gen(373);
+    std::uniform_int_distribution<std::size_t> noise(16, 256);
+    std::vector<void*> others;
+    others.reserve(keys.size());
+
+    clock::time_point b = clock::now();
+    for (int key : keys)
+    {
+        insert(c, key);
+        others.push_back(std::malloc(noise(gen)));
+    }
+    clock::time_point e = clock::now();
+    build = std::chrono::duration<double, std::nano>(e - b).count() / keys.size();
+
+    const int passes = 10;
+    long sum = 0;
+    b = clock::now();
+    for (int i = 0; i != passes; ++i)
+    {
+        for (const auto& element : c)
+        {
+            sum += value(element);
+        }
+    }
+    e = clock::now();
+    walk = std::chrono::duration<double, std::nano>(e - b).count() / (passes * keys.size());
+    if (sum == 0)
+    {
+        std::printf("unexpected sum\n");
+    }
+    for (void* p : others)
+    {
+        std::free(p);
+    }
+}
+
+/**
+ * build_and_walk for a container on an ArenaAllocator over a slab of its
+ * nodes, for the containers whose only allocations are nodes
+ * @return false if C allocates more than nodes, and nothing was run
+ */
+template <template <typename> class C, typename Node>
+bool slab_container (const std::vector<int>& keys, double& build, double& walk, Node*)
+{
+    typedef Allocator<Node, (1 << 26), Slab> slab_arena;
+    std::unique_ptr<slab_arena> arena(new slab_arena());
+    typename C<ArenaAllocator<int, slab_arena> >::type
+        c((ArenaAllocator<int, slab_arena>(*arena)));
+    build_and_walk(c, keys, build, walk);
+    return true;
+}
+
+template <template <typename> class C>
+bool slab_container (const std::vector<int>&, double&, double&, void*)
+{
+    return false;
+}
+
+/**
+ * build_and_walk for a container on std::allocator, on an ArenaAllocator
+ * over a container_arena and, if C only allocates nodes, on one over a
+ * slab of them
+ */
+template <template <typename> class C>
+void container (const char* name, std::size_t size)
+{
+    std::vector<int> keys(size);
+    for (std::size_t i = 0; i != size; ++i)
+    {
+        keys[i] = static_cast<int>(i) + 1;
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(373));
+
+    double std_build;
+    double std_walk;
+    {
+        typename C<std::allocator<int> >::type c;
+        build_and_walk(c, keys, std_build, std_walk);
+    }
+
+    double arena_build;
+    double arena_walk;
+    {
+        std::unique_ptr<container_arena> arena(new container_arena());
+        typename C<ArenaAllocator<int, container_arena> >::type
+            c((ArenaAllocator<int, container_arena>(*arena)));
+        build_and_walk(c, keys, arena_build, arena_walk);
+    }
+
+    double slab_build;
+    double slab_walk;
+    std::printf("%-14s %8zu %8.1f %8.1f %8.1f %8.1f", name, size,
+                std_build, std_walk, arena_build, arena_walk);
+    if (slab_container<C>(keys, slab_build, slab_walk,
+                          static_cast<typename C<std::allocator<int> >::node*>(nullptr)))
+    {
+        std::printf(" %8.1f %8.1f\n", slab_build, slab_walk);
+    }
+    else
+    {
+        std::printf(" %8s %8s\n", "-", "-");
+    }
+}
+
+template <typename A>
+struct list_of
+{
+    typedef std::list<int, A>      type;
+    typedef allocator_node<int, 2> node;
+};
+
+template <typename A>
+struct map_of
+{
+    typedef typename std::allocator_traits<A>::template rebind_alloc<std::pair<const int, int> >
+            allocator_type;
+    typedef std::map<int, int, std::less<int>, allocator_type> type;
+    typedef allocator_node<std::pair<const int, int>, 4>       node;
+};
+
+template <typename A>
+struct unordered_map_of
+{
+    typedef typename std::allocator_traits<A>::template rebind_alloc<std::pair<const int, int> >
+            allocator_type;
+    typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, allocator_type> type;
+    typedef void                                                                             node;
+};
+
+void containers ()
+{
+    std::printf("%-14s %8s %8s %8s %8s %8s %8s %8s  (ns per element)\n", "container", "size",
+                "build", "walk", "build", "walk", "build", "walk");
+    std::printf("%-14s %8s %17s %17s %17s\n", "", "", "std::allocator", "ArenaAllocator",
+                "over a Slab");
+    for (std::size_t size = 1 << 14; size <= (1 << 18); size <<= 2)
+    {
+        container<list_of>         ("list",          size);
+        container<map_of>          ("map",           size);
+        container<unordered_map_of>("unordered_map", size);
+    }
+}
+
+// -----
+// align
+// -----
+
+/**
+ * Allocates pairs of blocks of n floats from an Allocator<float, N>, with
+ * allocate or with allocate_aligned at alignment, and runs y += 3x over
+ * every pair repeatedly
+ * @return the nanoseconds per element
+ */
+template <std::size_t N>
+double saxpy (std::size_t n, std::size_t alignment)
+{
+    typedef std::chrono::steady_clock clock;
+    typedef Allocator<float, N> allocator_type;
+    std::unique_ptr<allocator_type> x(new allocator_type());
+    const std::size_t pairs = N / (8 * n * sizeof(float));
+    std::vector<float*> blocks;
+    for (std::size_t i = 0; i != 2 * pairs; ++i)
+    {
+        // An odd block between every two keeps allocate from lining them up
+        x->allocate(1 + i % 3);
+        blocks.push_back(alignment == 0 ? x->allocate(n) : x->allocate_aligned(n, alignment));
+        std::fill(blocks.back(), blocks.back() + n, 1.0f);
+    }
+
+    const int passes = 200;
+    clock::time_point b = clock::now();
+    for (int pass = 0; pass != passes; ++pass)
+    {
+        for (std::size_t i = 0; i != pairs; ++i)
+        {
+            float* __restrict__ dst = blocks[2 * i];
+            const float* __restrict__ src = blocks[2 * i + 1];
+            for (std::size_t j = 0; j != n; ++j)
+            {
+                dst[j] += 3 * src[j];
+            }
+        }
+    }
+    clock::time_point e = clock::now();
+    return std::chrono::duration<double, std::nano>(e - b).count() / (passes * pairs * n);
+}
+
+void align ()
+{
+    std::printf("%-10s %6s %12s %12s  (ns per element)\n", "saxpy", "n", "allocate",
+                "aligned 64");
+    for (std::size_t n = 16; n <= 1024; n *= 4)
+    {
+        std::printf("%-10s %6zu %12.3f %12.3f\n", "float", n,
+                    saxpy<1 << 18>(n, 0), saxpy<1 << 18>(n, 64));
+    }
+}
+
+// -------
+// startup
+// -------
+
+/**
+ * Builds an Allocator<char, N> eagerly or lazily, allocates 1 MB from it,
+ * and copies it
+ * @param lazy whether to construct it with allocator_lazy
+ * @param built the microseconds to construct it
+ * @param copied the microseconds to copy it
+ * @param touched the bytes that became resident for both heaps
+ */
+template <std::size_t N>
+void startup (bool lazy, double& built, double& copied, std::size_t& touched)
+{
+    typedef std::chrono::steady_clock clock;
+    typedef Allocator<char, N> allocator_type;
+    std::size_t before = resident();
+    clock::time_point b = clock::now();
+    std::unique_ptr<allocator_type> x(lazy ? new allocator_type(allocator_lazy)
+                                           : new allocator_type());
+    clock::time_point e = clock::now();
+    built = std::chrono::duration<double, std::micro>(e - b).count();
+
+    for (int i = 0; i != 1024; ++i)
+    {
+        std::memset(x->allocate(1000), 1, 1000);
+    }
+    b = clock::now();
+    std::unique_ptr<allocator_type> y(new allocator_type(*x));
+    e = clock::now();
+    copied  = std::chrono::duration<double, std::micro>(e - b).count();
+    touched = resident() - before;
+}
+
+void startup ()
+{
+    std::printf("%-10s %8s %12s %12s %12s  (1 MB in use)\n", "startup", "heap",
+                "construct us", "copy us", "resident MB");
+    for (bool lazy : {false, true})
+    {
+        double      built   = 0;
+        double      copied  = 0;
+        std::size_t touched = 0;
+        startup<std::size_t(1) << 28>(lazy, built, copied, touched);
+        std::printf("%-10s %6d MB %12.1f %12.1f %12zu\n", lazy ? "lazy" : "eager", 256,
+                    built, copied, touched >> 20);
+    }
+}
+
+// --------
+// locality
+// --------
+
+/**
+ * A 32 byte list node
+ */
+struct chase_node
+{
+    chase_node* next;
+    long        values[3];
+};
+
+/**
+ * Scatters free holes through an Allocator<chase_node, N>, then grows
+ * lists round robin, each node from allocate or from allocate_near its
+ * predecessor, and walks every list repeatedly. Without perf counters in
+ * reach the misses are shown by what causes them: how far apart
+ * consecutive nodes are, and how often a step crosses into another page.
+ * @param near whether to allocate each node near its predecessor
+ * @param distance the mean bytes between consecutive nodes
+ * @param pages the percentage of steps that cross a 4 KB page
+ * @return the nanoseconds per node walked
+ */
+template <std::size_t N>
+double chase (bool near, double& distance, double& pages)
+{
+    typedef std::chrono::steady_clock clock;
+    typedef Allocator<chase_node, N> allocator_type;
+    std::unique_ptr<allocator_type> x(new allocator_type());
+    std::mt19937 gen(371);
+
+    // Fill three quarters of the heap and free half of it at random
+    std::vector<std::pair<chase_node*, std::size_t> > fillers;
+    std::uniform_int_distribution<std::size_t> sizes(1, 4);
+    std::size_t used = 0;
+    while (used < 3 * N / 4)
+    {
+        std::size_t n = sizes(gen);
+        fillers.push_back(std::make_pair(x->allocate(n), n));
+        used += n * sizeof(chase_node) + 2 * sizeof(int);
+    }
+    std::shuffle(fillers.begin(), fillers.end(), gen);
+    for (std::size_t i = 0; i != fillers.size() / 2; ++i)
+    {
+        x->deallocate(fillers[i].first, fillers[i].second);
+    }
+
+    const std::size_t lists = 64;
+    const std::size_t nodes = N / (8 * sizeof(chase_node) * lists);
+    std::vector<chase_node*> heads(lists, nullptr);
+    std::vector<chase_node*> tails(lists, nullptr);
+    for (std::size_t i = 0; i != nodes; ++i)
+    {
+        for (std::size_t l = 0; l != lists; ++l)
+        {
+            chase_node* p = near ? x->allocate_near(1, tails[l]) : x->allocate(1);
+            p->next      = nullptr;
+            p->values[0] = static_cast<long>(i);
+            (tails[l] == nullptr ? heads[l] : tails[l]->next) = p;
+            tails[l] = p;
+        }
+    }
+
+    double      bytes   = 0;
+    std::size_t crossed = 0;
+    for (chase_node* h : heads)
+    {
+        for (chase_node* p = h; p->next != nullptr; p = p->next)
+        {
+            std::uintptr_t a = reinterpret_cast<std::uintptr_t>(p);
+            std::uintptr_t b = reinterpret_cast<std::uintptr_t>(p->next);
+            bytes   += a < b ? b - a : a - b;
+            crossed += (a >> 12) != (b >> 12);
+        }
+    }
+    const std::size_t steps = lists * (nodes - 1);
+    distance = bytes / steps;
+    pages    = 100.0 * crossed / steps;
+
+    const int passes = 20;
+    long sum = 0;
+    clock::time_point b = clock::now();
+    for (int pass = 0; pass != passes; ++pass)
+    {
+        for (chase_node* h : heads)
+        {
+            for (chase_node* p = h; p != nullptr; p = p->next)
+            {
+                sum += p->values[0];
+            }
+        }
+    }
+    clock::time_point e = clock::now();
+    if (sum == -1)
+    {
+        std::printf("%ld\n", sum);
+    }
+    return std::chrono::duration<double, std::nano>(e - b).count() / (passes * lists * nodes);
+}
+
+void locality ()
+{
+    std::printf("%-10s %8s %12s %12s %12s  (64 lists grown round robin)\n", "chase",
+                "heap", "ns per node", "bytes apart", "% new page");
+    for (bool near : {false, true})
+    {
+        double distance = 0;
+        double pages    = 0;
+        double ns       = chase<1 << 24>(near, distance, pages);
+        std::printf("%-10s %5d MB %12.2f %12.0f %12.1f\n",
+                    near ? "near" : "allocate", 16, ns, distance, pages);
+    }
+}
+
+// -------
+// threads
+// -------
+
+/**
+ * Allocator<T, N> behind one mutex, what ConcurrentAllocator is measured
+ * against
+ */
+template <typename T, std::size_t N>
+struct locked_subject
+{
+    arena_subject<T, N> arena;
+    std::mutex          lock;
+
+    T* allocate (std::size_t n)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return arena.allocate(n);
+    }
+
+    void deallocate (T* p, std::size_t n)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        arena.deallocate(p, n);
+    }
+};
+
+/**
+ * ConcurrentAllocator<T, N, Arenas> in static storage, reporting bad_alloc
+ * as nullptr
+ */
+template <typename T, std::size_t N, std::size_t Arenas>
+struct concurrent_subject
+{
+    typedef ConcurrentAllocator<T, N, Arenas> allocator_type;
+
+    static allocator_type& x ()
+    {
+        static allocator_type x;
+        return x;
+    }
+
+    T* allocate (std::size_t n)
+    {
+        try
+        {
+            return x().allocate(n);
+        }
+        catch (std::bad_alloc&)
+        {
+            return nullptr;
+        }
+    }
+
+    void deallocate (T* p, std::size_t n)
+    {
+        x().deallocate(p, n);
+    }
+};
+
+/**
+ * Replays trace in each of threads threads at once through subject s,
+ * every thread with blocks of its own
+ * @return the operations per second of all the threads together
+ */
+template <typename T, typename S>
+double scale (S& s, const compiled_trace& trace, std::size_t threads)
+{
+    typedef std::chrono::steady_clock clock;
+    std::atomic<bool> go(false);
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t != threads; ++t)
+    {
+        pool.push_back(std::thread([&s, &trace, &go] ()
+        {
+            std::vector<T*>          ptrs(trace.slots, nullptr);
+            std::vector<std::size_t> counts(trace.slots, 0);
+            while (!go)
+            {
+                std::this_thread::yield();
+            }
+            for (const compiled_trace::operation& op : trace.ops)
+            {
+                T*& p = ptrs[op.slot];
+                if (op.allocate)
+                {
+                    counts[op.slot] = elements<T>(op.bytes);
+                    p = s.allocate(counts[op.slot]);
+                }
+                else if (p != nullptr)
+                {
+                    s.deallocate(p, counts[op.slot]);
+                    p = nullptr;
+                }
+            }
+            for (std::size_t i = 0; i != ptrs.size(); ++i)
+            {
+                if (ptrs[i] != nullptr)
+                {
+                    s.deallocate(ptrs[i], counts[i]);
+                }
+            }
+        }));
+    }
+
+    clock::time_point b = clock::now();
+    go = true;
+    for (std::thread& t : pool)
+    {
+        t.join();
+    }
+    clock::time_point e = clock::now();
+    return threads * trace.ops.size() / std::chrono::duration<double>(e - b).count();
+}
+
+/**
+ * Pairs of threads in which a producer allocates blocks of 2 Ts and hands
+ * them through a ring to a consumer that frees them
+ * @return the blocks per second of all the pairs together
+ */
+template <typename T, typename S>
+double pipeline (S& s, std::size_t pairs)
+{
+    typedef std::chrono::steady_clock clock;
+    const std::size_t capacity = 1024;
+    struct ring
+    {
+        std::atomic<std::size_t> head;
+        std::atomic<std::size_t> tail;
+        T*                       slots[capacity];
+    };
+    std::unique_ptr<ring[]> rings(new ring[pairs]);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t != pairs; ++t)
+    {
+        ring& r = rings[t];
+        r.head = 0;
+        r.tail = 0;
+        pool.push_back(std::thread([&s, &r, &go, capacity] ()
+        {
+            while (!go)
+            {
+                std::this_thread::yield();
+            }
+            for (std::size_t i = 0; i != operations; ++i)
+            {
+                T* p = s.allocate(2);
+                while (p == nullptr || r.tail - r.head.load() == capacity)
+                {
+                    std::this_thread::yield();
+                    if (p == nullptr)
+                    {
+                        p = s.allocate(2);
+                    }
+                }
+                r.slots[r.tail % capacity] = p;
+                r.tail.store(r.tail + 1);
+            }
+        }));
+        pool.push_back(std::thread([&s, &r, &go, capacity] ()
+        {
+            while (!go)
+            {
+                std::this_thread::yield();
+            }
+            for (std::size_t i = 0; i != operations; ++i)
+            {
+                while (r.tail.load() == r.head)
+                {
+                    std::this_thread::yield();
+                }
+                s.deallocate(r.slots[r.head % capacity], 2);
+                r.head.store(r.head + 1);
+            }
+        }));
+    }
+
+    clock::time_point b = clock::now();
+    go = true;
+    for (std::thread& t : pool)
+    {
+        t.join();
+    }
+    clock::time_point e = clock::now();
+    return pairs * operations / std::chrono::duration<double>(e - b).count();
+}
+
+/**
+ * The random workload in 1 to max_threads threads, then producer and
+ * consumer pairs, on ConcurrentAllocator with an arena per thread, on one
+ * Allocator behind a mutex, and on malloc
+ */
+void threads ()
+{
+    std::printf("%7s %12s %12s %12s  (Mops/s, %u hardware threads)\n",
+                "threads", "Concurrent", "locked", "malloc",
+                std::thread::hardware_concurrency());
+    compiled_trace trace(make_workload(workloads[2], thread_heap));
+    for (std::size_t n = 1; n <= max_threads; n *= 2)
+    {
+        concurrent_subject<int, thread_heap, max_threads> concurrent;
+        std::unique_ptr<locked_subject<int, max_threads * thread_heap> >
+            locked(new locked_subject<int, max_threads * thread_heap>());
+        malloc_subject<int> malloc_free;
+        std::printf("%7zu %12.2f %12.2f %12.2f\n", n,
+                    scale<int>(concurrent,  trace, n) / 1e6,
+                    scale<int>(*locked,     trace, n) / 1e6,
+                    scale<int>(malloc_free, trace, n) / 1e6);
+    }
+
+    std::printf("\n%7s %12s %12s %12s  (M blocks/s, freed by another thread)\n",
+                "pairs", "Concurrent", "locked", "malloc");
+    for (std::size_t n = 1; n <= max_threads / 2; n *= 2)
+    {
+        concurrent_subject<int, thread_heap, max_threads> concurrent;
+        std::unique_ptr<locked_subject<int, max_threads * thread_heap> >
+            locked(new locked_subject<int, max_threads * thread_heap>());
+        malloc_subject<int> malloc_free;
+        std::printf("%7zu %12.2f %12.2f %12.2f\n", n,
+                    pipeline<int>(concurrent,  n) / 1e6,
+                    pipeline<int>(*locked,     n) / 1e6,
+                    pipeline<int>(malloc_free, n) / 1e6);
+    }
+}
+
+// ----
+// main
+// ----
+
+int main (int argc, char* argv[])
+{
+    try
+    {
+        if (argc == 4 && std::strcmp(argv[1], "--write") == 0)
+        {
+            for (const workload& w : workloads)
+            {
+                if (std::strcmp(argv[2], w.name) == 0)
+                {
+                    write_trace(argv[3], make_workload(w, replay_size));
+                    return 0;
+                }
+            }
+            std::fprintf(stderr, "unknown workload %s\n", argv[2]);
+            return 1;
+        }
+
+        header();
+        if (argc > 1)
+        {
+            for (int i = 1; i != argc; ++i)
+            {
+                compiled_trace trace(read_trace(argv[i]));
+
+                arena_subject<char, replay_size> arena;
+                report<char>("Allocator", "char", replay_size, argv[i], arena, trace);
+
+                std_subject<char> std_allocator;
+                report<char>("std", "char", replay_size, argv[i], std_allocator, trace);
+
+                malloc_subject<char> malloc_free;
+                report<char>("malloc", "char", replay_size, argv[i], malloc_free, trace);
+            }
+            return 0;
+        }
+
+        suite<char,   1 << 16>("char");
+        suite<char,   1 << 20>("char");
+        suite<int,    1 << 16>("int");
+        suite<int,    1 << 20>("int");
+        suite<double, 1 << 16>("double");
+        suite<double, 1 << 20>("double");
+        suite<record, 1 << 16>("record");
+        suite<record, 1 << 20>("record");
+        std::printf("\n");
+        policies<1 << 18>();
+        std::printf("\n");
+        growth<1 << 20>();
+        std::printf("\n");
+        bulk<1 << 20>();
+        std::printf("\n");
+        lazy();
+        std::printf("\n");
+        densities();
+        std::printf("\n");
+        nodes();
+        std::printf("\n");
+        containers();
+        std::printf("\n");
+        align();
+        std::printf("\n");
+        startup();
+        std::printf("\n");
+        locality();
+        std::printf("\n");
+        threads();
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,655 @@
+/** @file CompactAllocator.h
+ * @brief Contains a boundary-tag allocator that keeps footers only on free
+ *        blocks
+ */
+
+// -------------------------------------
+// projects/allocator/CompactAllocator.h
+// -------------------------------------
+
+#ifndef CompactAllocator_h
+#define CompactAllocator_h
+
+// --------
+// includes
+// --------
+
+#include <cstddef>    // ptrdiff_t, size_t
+#include <cstdio>     // fprintf
+#include <cstdlib>    // abort
+#include <functional> // less
+#include <new>        // bad_alloc, new
+#include <stdexcept>  // invalid_argument
+
+#include "Allocator.h" // ALLOCATOR_CHECK, allocator_log2, allocator_round_up
+
+// ----------------
+// CompactAllocator
+// ----------------
+
+/**
+ * Allocator<T, N> with footer elision: a busy block is one int header and
+ * its payload, and only a free block also ends with a footer. The header
+ * holds the size of the whole block, a multiple of grain, with the bit
+ * busy_bit set if the block is busy and prev_free_bit set if the block
+ * before it is free, which is when deallocate may read that block's footer
+ * to coalesce backwards. A block of one 4 byte T costs 8 bytes instead of
+ * Allocator's 12.
+ *
+ * Free blocks big enough to hold two links are kept in one size class per
+ * power of two, as GrowableAllocator does; smaller ones are only counted
+ * and found by walking the headers, as Allocator does with its tiny
+ * blocks. Payloads start sizeof(int) bytes into a block, as in Allocator,
+ * and are aligned for T the same way: a[] sits sizeof(int) bytes before an
+ * alignment boundary and every block is a multiple of alignof(T). For a T
+ * aligned to 8 bytes that rounding costs what the footer saves, so the
+ * layout only pays off for Ts aligned to at most sizeof(int). The public
+ * API and check() are Allocator's; operator[] reads the int at a byte
+ * offset, whose meaning differs.
+ */
+template <typename T, std::size_t N>
+class CompactAllocator
+{
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
+        /**
+         * Every CompactAllocator owns its own heap, so only an allocator can
+         * deallocate what it allocated
+         */
+        friend bool operator == (const CompactAllocator& lhs, const CompactAllocator& rhs)
+        {
+            return &lhs == &rhs;
+        }
+
+        // -----------
+        // operator !=
+        // -----------
+
+        friend bool operator != (const CompactAllocator& lhs, const CompactAllocator& rhs)
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        // ----
+        // data
+        // ----
+
+        static const int busy_bit      = 1;
+        static const int prev_free_bit = 2;
+        static const int flags         = busy_bit | prev_free_bit;
+
+        /**
+         * Every block size is a multiple of grain, so every block starts at
+         * a multiple of it and, with lead in front of a[], every payload is
+         * aligned for T
+         */
+        static const int grain = alignof(T) > sizeof(int) ? alignof(T) : sizeof(int);
+        static constexpr std::size_t lead_align = alignof(T) > 2 * sizeof(int) ?
+                                                  alignof(T) : 2 * sizeof(int);
+
+        static const int min_block  = 2 * sizeof(int); // header and footer
+        static const int min_linked = 4 * sizeof(int); // and two links
+        static const int heap_size  = N / grain * grain;
+        static const int classes    = allocator_log2(N) + 1;
+
+        alignas(lead_align) char lead[lead_align - sizeof(int)];
+        char     a[N];
+        int      bins[classes];
+        unsigned bitmap;
+        size_t   tiny_free;
+
+        #if ALLOCATOR_CHECK >= 2
+        size_t unchecked;
+        #endif
+
+        // -----
+        // words
+        // -----
+
+        int& operator [] (int i)
+        {
+            return *reinterpret_cast<int*>(&a[i]);
+        }
+
+        static int round_up (std::size_t bytes)
+        {
+            return static_cast<int>(allocator_round_up(bytes, grain));
+        }
+
+        int size_of (int block) const
+        {
+            return (*this)[block] & ~flags;
+        }
+
+        bool busy (int block) const
+        {
+            return ((*this)[block] & busy_bit) != 0;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Writes the header, and the footer if the block is free. The block
+         * before a free block is always busy, and the block before a busy
+         * one keeps whatever prev_free_bit said.
+         */
+        void set_block (int block, int size, bool is_busy)
+        {
+            if (is_busy)
+            {
+                (*this)[block] = size | busy_bit | ((*this)[block] & prev_free_bit);
+            }
+            else
+            {
+                (*this)[block] = size;
+                (*this)[block + size - sizeof(int)] = size;
+            }
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Tells the block after block, if any, whether block is free
+         */
+        void set_next_prev_free (int block, bool is_free)
+        {
+            int next = block + size_of(block);
+            if (next < heap_size)
+            {
+                (*this)[next] = is_free ? (*this)[next] | prev_free_bit
+                                        : (*this)[next] & ~prev_free_bit;
+            }
+        }
+
+        int& next_free (int block)
+        {
+            return (*this)[block + sizeof(int)];
+        }
+
+        int next_free (int block) const
+        {
+            return (*this)[block + sizeof(int)];
+        }
+
+        int& prev_free (int block)
+        {
+            return (*this)[block + 2 * sizeof(int)];
+        }
+
+        int prev_free (int block) const
+        {
+            return (*this)[block + 2 * sizeof(int)];
+        }
+
+        // ------------
+        // size classes
+        // ------------
+
+        static int size_class (int size)
+        {
+            return 31 - __builtin_clz(static_cast<unsigned>(size));
+        }
+
+        void insert_free (int block)
+        {
+            int size = size_of(block);
+            if (size < min_linked)
+            {
+                ++tiny_free;
+                return;
+            }
+            int c = size_class(size);
+            next_free(block) = bins[c];
+            prev_free(block) = -1;
+            if (bins[c] != -1)
+            {
+                prev_free(bins[c]) = block;
+            }
+            bins[c] = block;
+            bitmap |= 1u << c;
+        }
+
+        void remove_free (int block)
+        {
+            int size = size_of(block);
+            if (size < min_linked)
+            {
+                --tiny_free;
+                return;
+            }
+            int c    = size_class(size);
+            int next = next_free(block);
+            int prev = prev_free(block);
+            if (next != -1)
+            {
+                prev_free(next) = prev;
+            }
+            if (prev != -1)
+            {
+                next_free(prev) = next;
+            }
+            else
+            {
+                bins[c] = next;
+                if (next == -1)
+                {
+                    bitmap &= ~(1u << c);
+                }
+            }
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time, unless only the request's own class or the tiny
+         * blocks can hold it
+         * A free block of at least size bytes: the first one in the first
+         * non-empty class above the request's, where every block fits, or
+         * failing that one from the request's own class, or failing that,
+         * for a request small enough, a tiny one found by walking the heap
+         * @return its offset, or -1
+         */
+        int find_free (int size) const
+        {
+            int c     = size_class(size);
+            int above = (size & (size - 1)) == 0 ? c : c + 1;
+            unsigned map = above < 32 ? bitmap & (~0u << above) : 0;
+            if (map != 0)
+            {
+                return bins[__builtin_ctz(map)];
+            }
+            if (c < classes)
+            {
+                for (int block = bins[c]; block != -1; block = next_free(block))
+                {
+                    if (size_of(block) >= size)
+                    {
+                        return block;
+                    }
+                }
+            }
+            if (tiny_free != 0 && size < min_linked)
+            {
+                for (int block = 0; block < heap_size; block += size_of(block))
+                {
+                    if (!busy(block) && size_of(block) >= size)
+                    {
+                        return block;
+                    }
+                }
+            }
+            return -1;
+        }
+
+        // -----
+        // valid
+        // -----
+
+        FRIEND_TEST(TestCompact, compact_4);
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Whether block has a plausible size, a matching footer if it is
+         * free, no free neighbour if it is free, and a successor whose
+         * prev_free_bit says what block is
+         */
+        bool valid_block (int block) const
+        {
+            if (block < 0 || block % grain != 0 || block + min_block > heap_size)
+            {
+                return false;
+            }
+            int size = size_of(block);
+            if (size < min_block || size % grain != 0 || block + size > heap_size)
+            {
+                return false;
+            }
+            bool prev_is_free = ((*this)[block] & prev_free_bit) != 0;
+            if (!busy(block) && (prev_is_free || (*this)[block + size - sizeof(int)] != size))
+            {
+                return false;
+            }
+            int next = block + size;
+            if (next != heap_size)
+            {
+                bool next_says = ((*this)[next] & prev_free_bit) != 0;
+                if (next_says == busy(block) || (!busy(block) && !busy(next)))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * Whether the headers tile the heap, every block is valid, and the
+         * size classes and tiny count hold exactly the free blocks
+         */
+        bool valid () const
+        {
+            if (block_of_heap_end() != heap_size)
+            {
+                return false;
+            }
+            size_t linked = 0;
+            size_t tiny   = 0;
+            for (int block = 0; block != heap_size; block += size_of(block))
+            {
+                if (!valid_block(block))
+                {
+                    return false;
+                }
+                if (!busy(block))
+                {
+                    ++(size_of(block) < min_linked ? tiny : linked);
+                }
+            }
+            if (block_prev_free(0))
+            {
+                return false;
+            }
+            for (int c = 0; c != classes; ++c)
+            {
+                if ((bins[c] != -1) != ((bitmap >> c) & 1))
+                {
+                    return false;
+                }
+                int prev = -1;
+                for (int block = bins[c]; block != -1; block = next_free(block))
+                {
+                    if (busy(block) || size_class(size_of(block)) != c ||
+                        prev_free(block) != prev || linked-- == 0)
+                    {
+                        return false;
+                    }
+                    prev = block;
+                }
+            }
+            return linked == 0 && tiny == tiny_free;
+        }
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * Where walking the headers from 0 stops: heap_size in a valid heap
+         */
+        int block_of_heap_end () const
+        {
+            int block = 0;
+            while (block < heap_size)
+            {
+                int size = size_of(block);
+                if (size < min_block)
+                {
+                    return -1;
+                }
+                block += size;
+            }
+            return block;
+        }
+
+        bool block_prev_free (int block) const
+        {
+            return ((*this)[block] & prev_free_bit) != 0;
+        }
+
+        /**
+         * Runs the checks ALLOCATOR_CHECK asks for on a block the caller has
+         * just changed, and aborts if they fail
+         */
+        void checked (int block)
+        {
+            #if ALLOCATOR_CHECK >= 1
+            if (!valid_block(block))
+            {
+                std::fprintf(stderr, "CompactAllocator: block %d of heap at %p is corrupt\n",
+                             block, static_cast<const void*>(a));
+                std::abort();
+            }
+            #endif
+            #if ALLOCATOR_CHECK >= 2
+            if (++unchecked == ALLOCATOR_CHECK_PERIOD)
+            {
+                unchecked = 0;
+                if (!valid())
+                {
+                    std::fprintf(stderr, "CompactAllocator: heap at %p is corrupt\n",
+                                 static_cast<const void*>(a));
+                    std::abort();
+                }
+            }
+            #endif
+            (void) block;
+        }
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * throw a bad_alloc exception, if N cannot hold one block of one T
+         */
+        CompactAllocator ()
+        {
+            if (heap_size < min_block || heap_size < round_up(sizeof(int) + sizeof(T)))
+            {
+                std::bad_alloc e;
+                throw e;
+            }
+            for (int c = 0; c != classes; ++c)
+            {
+                bins[c] = -1;
+            }
+            bitmap    = 0;
+            tiny_free = 0;
+            set_block(0, heap_size, false);
+            insert_free(0);
+
+            #if ALLOCATOR_CHECK >= 2
+            unchecked = 0;
+            #endif
+            checked(0);
+        }
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time, unless only the request's own class or the tiny
+         * blocks can hold it
+         * Allocates at least enough space for n Ts in a block of a header
+         * and the payload, rounded up to a multiple of grain and to at least
+         * min_block bytes, splitting off the rest of the block found if it
+         * can be a block of its own
+         * throw a bad_alloc exception, if there is no room for n Ts
+         */
+        pointer allocate (size_type n)
+        {
+            if (n * sizeof(T) > N)
+            {
+                std::bad_alloc e;
+                throw e;
+            }
+            if (n == 0)
+            {
+                return nullptr;
+            }
+            int size = round_up(sizeof(int) + n * sizeof(T));
+            if (size < min_block)
+            {
+                size = min_block;
+            }
+
+            int block = find_free(size);
+            if (block == -1)
+            {
+                std::bad_alloc e;
+                throw e;
+            }
+            remove_free(block);
+
+            int total = size_of(block);
+            if (total - size >= min_block)
+            {
+                int rest = block + size;
+                set_block(rest, total - size, false);
+                insert_free(rest);
+                total = size;
+            }
+            else
+            {
+                set_next_prev_free(block, false);
+            }
+            set_block(block, total, true);
+
+            checked(block);
+            return reinterpret_cast<pointer>(&a[block + sizeof(int)]);
+        }
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void construct (pointer p, const_reference v)
+        {
+            new (p) T(v); // this is correct and exempt
+                          // from the prohibition of new
+        }
+
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Frees the block at p, coalescing it with the block after it if
+         * that is free, and with the block before it if its prev_free_bit
+         * says so
+         * throw an invalid_argument exception, if p is invalid
+         */
+        void deallocate (pointer p, size_type)
+        {
+            const char* c = reinterpret_cast<const char*>(p);
+            std::less<const char*> less;
+            if (p == nullptr || less(c, a + sizeof(int)) || !less(c, a + heap_size))
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            int block = static_cast<int>(c - a) - sizeof(int);
+            if (block % grain != 0 || !busy(block) ||
+                size_of(block) < min_block || block + size_of(block) > heap_size)
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+
+            int begin = block;
+            int size  = size_of(block);
+            int next  = block + size;
+            if (next != heap_size && !busy(next))
+            {
+                remove_free(next);
+                size += size_of(next);
+            }
+            if (block_prev_free(block))
+            {
+                begin -= (*this)[block - sizeof(int)];
+                remove_free(begin);
+                size += size_of(begin);
+            }
+
+            set_block(begin, size, false);
+            set_next_prev_free(begin, true);
+            insert_free(begin);
+
+            checked(begin);
+        }
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void destroy (pointer p)
+        {
+            p->~T(); // this is correct
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The int at byte offset i of a[], read only
+         */
+        const int& operator [] (int i) const
+        {
+            return *reinterpret_cast<const int*>(&a[i]);
+        }
+
+        // ----
+        // owns
+        // ----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Whether p points into a[], i.e. could have come from this allocator
+         * @param p any pointer
+         */
+        bool owns (const void* p) const
+        {
+            const char* c = static_cast<const char*>(p);
+            std::less<const char*> less;
+            return !less(c, a) && less(c, a + N);
+        }
+
+        // -----
+        // check
+        // -----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * On-demand full sweep of the heap, whatever ALLOCATOR_CHECK is
+         * @return whether a[] is a valid heap
+         */
+        bool check () const
+        {
+            return valid();
+        }
+};
+
+#endif // CompactAllocator_h
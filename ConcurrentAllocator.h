@@ -0,0 +1,496 @@
+/** @file ConcurrentAllocator.h
+ * @brief Contains a thread-safe allocator built from per-thread Allocator
+ *        arenas
+ */
+
+// ----------------------------------------
+// projects/allocator/ConcurrentAllocator.h
+// ----------------------------------------
+
+#ifndef ConcurrentAllocator_h
+#define ConcurrentAllocator_h
+
+// --------
+// includes
+// --------
+
+#include <algorithm>  // sort
+#include <atomic>     // atomic, memory_order
+#include <cstddef>    // ptrdiff_t, size_t
+#include <cstring>    // memcpy
+#include <functional> // less
+#include <mutex>      // lock_guard, mutex, try_to_lock, unique_lock
+#include <new>        // bad_alloc, new
+#include <stdexcept>  // invalid_argument
+#include <utility>    // make_pair, pair
+
+#include "Allocator.h"
+
+// ----------------
+// allocator_thread
+// ----------------
+
+/**
+ * O(1) in space
+ * O(1) in time
+ * A small id for the calling thread, handed out in the order in which threads
+ * first ask for one
+ */
+inline unsigned allocator_thread ()
+{
+    static std::atomic<unsigned> next(0);
+    thread_local unsigned id = next++;
+    return id;
+}
+
+// -------------------
+// ConcurrentAllocator
+// -------------------
+
+/**
+ * Arenas Allocator<T, N, Policy> heaps, each behind its own mutex. Threads
+ * are spread over the arenas in the order they first allocate, so with at
+ * least as many arenas as threads every thread allocates from an arena of
+ * its own and its mutex is never contended. A block is always given back to
+ * the arena it came from: by the thread that allocates from that arena
+ * directly, and by any other thread through a lock-free stack that the
+ * arena drains the next time it allocates. When a thread's arena
+ * cannot hold a request the thread moves to the first idle arena that can.
+ * The arenas are stored inline, so a ConcurrentAllocator is a little over
+ * Arenas * N bytes; before C++17 new does not honour its alignment, so give
+ * it static storage.
+ */
+template <typename T, std::size_t N, std::size_t Arenas = 16, typename Policy = GoodFit>
+class ConcurrentAllocator
+{
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
+        /**
+         * Every ConcurrentAllocator owns its own arenas, so only an allocator
+         * can deallocate what it allocated
+         */
+        friend bool operator == (const ConcurrentAllocator& lhs, const ConcurrentAllocator& rhs)
+        {
+            return &lhs == &rhs;
+        }
+
+        // -----------
+        // operator !=
+        // -----------
+
+        friend bool operator != (const ConcurrentAllocator& lhs, const ConcurrentAllocator& rhs)
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        // ----
+        // data
+        // ----
+
+        /**
+         * Payloads are at least a block's two sentinels apart, so one bit
+         * per this many bytes tells every block on a remote stack apart
+         */
+        static const std::size_t pending_grain = 2 * sizeof(int);
+        static const std::size_t pending_words =
+            sizeof(Allocator<T, N, Policy>) / pending_grain / 32 + 1;
+
+        /**
+         * One heap and the mutex that guards it, on cache lines of their own
+         * so that threads working in neighbouring arenas do not share lines.
+         * remote is the head of a stack of blocks freed by other threads and
+         * not yet given back to heap: the offset of a block's payload from
+         * heap, with the next offset in the first int of the payload, the
+         * number of Ts it was allocated with in the second, and -1 at the
+         * bottom. pending has a bit per pending_grain bytes of heap, set
+         * while the block whose payload starts there is on the stack, so
+         * that a block cannot be freed twice before it is drained.
+         */
+        struct alignas(64) arena
+        {
+            std::mutex              lock;
+            std::atomic<int>        remote;
+            Allocator<T, N, Policy> heap;
+            std::atomic<unsigned>   pending[pending_words];
+
+            arena () :
+                lock(),
+                remote(-1),
+                heap()
+            {
+                for (std::atomic<unsigned>& word : pending)
+                {
+                    word.store(0, std::memory_order_relaxed);
+                }
+            }
+        };
+
+        /**
+         * Most remote frees sorted and given back to a heap at a time
+         */
+        static const std::size_t drain_batch = 64;
+
+        FRIEND_TEST(TestConcurrent, concurrent_1);
+        FRIEND_TEST(TestConcurrent, concurrent_2);
+        FRIEND_TEST(TestConcurrent, concurrent_3);
+        FRIEND_TEST(TestConcurrent, concurrent_5);
+        FRIEND_TEST(TestConcurrent, concurrent_6);
+        FRIEND_TEST(TestConcurrent, concurrent_7);
+        arena arenas[Arenas];
+
+        // ----
+        // home
+        // ----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The index of the calling thread's arena
+         */
+        static unsigned& home ()
+        {
+            thread_local unsigned index = allocator_thread() % Arenas;
+            return index;
+        }
+
+        // -----
+        // owner
+        // -----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The arena that p was allocated from, found from its address
+         * @param p any pointer
+         * @return the arena whose heap p points into, or nullptr
+         */
+        arena* owner (const_pointer p)
+        {
+            const char* c     = reinterpret_cast<const char*>(p);
+            const char* begin = reinterpret_cast<const char*>(arenas);
+            std::less<const char*> less;
+            if (less(c, begin) || !less(c, begin + sizeof(arenas)))
+            {
+                return nullptr;
+            }
+            arena& a = arenas[(c - begin) / sizeof(arena)];
+            return a.heap.owns(p) ? &a : nullptr;
+        }
+
+        // -------
+        // pending
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Marks p as on the remote stack of a, or clears the mark
+         * @param on whether to mark or to clear
+         * @return whether p was marked before
+         */
+        static bool set_pending (arena& a, const_pointer p, bool on)
+        {
+            std::size_t bit = (reinterpret_cast<const char*>(p) -
+                               reinterpret_cast<const char*>(&a.heap)) / pending_grain;
+            unsigned mask = 1u << (bit % 32);
+            unsigned old  = on ? a.pending[bit / 32].fetch_or(mask, std::memory_order_acq_rel)
+                               : a.pending[bit / 32].fetch_and(~mask, std::memory_order_acq_rel);
+            return (old & mask) != 0;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Whether p is on the remote stack of a
+         */
+        static bool pending (arena& a, const_pointer p)
+        {
+            std::size_t bit = (reinterpret_cast<const char*>(p) -
+                               reinterpret_cast<const char*>(&a.heap)) / pending_grain;
+            return (a.pending[bit / 32].load(std::memory_order_acquire) >> (bit % 32) & 1) != 0;
+        }
+
+        // ------
+        // remote
+        // ------
+
+        /**
+         * O(1) in space
+         * O(1) in time, retried while other threads push onto the same stack
+         * Pushes p onto the remote stack of a without taking its lock. The
+         * stack is only ever emptied whole, so a compare and swap on the head
+         * is enough.
+         */
+        static void push_remote (arena& a, pointer p, size_type n)
+        {
+            int offset = static_cast<int>(reinterpret_cast<char*>(p) -
+                                          reinterpret_cast<char*>(&a.heap));
+            int count  = static_cast<int>(n);
+            std::memcpy(reinterpret_cast<char*>(p) + sizeof(int), &count, sizeof(int));
+            int head = a.remote.load(std::memory_order_relaxed);
+            do
+            {
+                std::memcpy(p, &head, sizeof(int));
+            }
+            while (!a.remote.compare_exchange_weak(head, offset,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed));
+        }
+
+        /**
+         * O(drain_batch) in space
+         * O(n log(drain_batch)) in time, for n remote frees
+         * Gives every block on the remote stack of a back to its heap, in
+         * batches that deallocate_bulk coalesces a run at a time, one call
+         * per size in the batch. A batch that deallocate_bulk refuses is
+         * given back a block at a time, skipping the invalid ones, so one
+         * bad block does not lose the rest of the stack. The caller holds
+         * the lock of a.
+         */
+        static void drain (arena& a)
+        {
+            int head = a.remote.exchange(-1, std::memory_order_acquire);
+            std::pair<size_type, pointer> batch[drain_batch];
+            std::size_t size = 0;
+            while (head != -1)
+            {
+                pointer p = reinterpret_cast<pointer>(reinterpret_cast<char*>(&a.heap) + head);
+                int count = 0;
+                std::memcpy(&head, p, sizeof(int));
+                std::memcpy(&count, reinterpret_cast<char*>(p) + sizeof(int), sizeof(int));
+                batch[size++] = std::make_pair(static_cast<size_type>(count), p);
+                if (size == drain_batch || head == -1)
+                {
+                    // Blocks of the same size end up next to each other
+                    std::sort(batch, batch + size);
+                    pointer ptrs[drain_batch];
+                    std::size_t i = 0;
+                    while (i != size)
+                    {
+                        std::size_t j = i;
+                        for (; j != size && batch[j].first == batch[i].first; ++j)
+                        {
+                            ptrs[j - i] = batch[j].second;
+                        }
+                        try
+                        {
+                            a.heap.deallocate_bulk(ptrs, j - i, batch[i].first);
+                        }
+                        catch (std::invalid_argument&)
+                        {
+                            for (std::size_t k = 0; k != j - i; ++k)
+                            {
+                                try
+                                {
+                                    a.heap.deallocate(ptrs[k], batch[i].first);
+                                }
+                                catch (std::invalid_argument&)
+                                {
+                                }
+                            }
+                        }
+                        for (std::size_t k = 0; k != j - i; ++k)
+                        {
+                            set_pending(a, ptrs[k], false);
+                        }
+                        i = j;
+                    }
+                    size = 0;
+                }
+            }
+        }
+
+        // ---------
+        // try_arena
+        // ---------
+
+        /**
+         * Allocates n Ts from an arena whose lock the caller holds, after
+         * draining its remote frees
+         * @return the pointer, or nullptr if the arena cannot hold n Ts
+         */
+        static pointer try_arena (arena& a, size_type n)
+        {
+            if (a.remote.load(std::memory_order_relaxed) != -1)
+            {
+                drain(a);
+            }
+            try
+            {
+                return a.heap.allocate(n);
+            }
+            catch (std::bad_alloc&)
+            {
+                return nullptr;
+            }
+        }
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(Arenas) in time
+         * throw a bad_alloc exception, if N is less than sizeof(T) +
+         * (2 * sizeof(int))
+         */
+        ConcurrentAllocator () = default;
+
+        ConcurrentAllocator (const ConcurrentAllocator&) = delete;
+        ConcurrentAllocator& operator = (const ConcurrentAllocator&) = delete;
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time from the thread's own arena, O(Arenas) when it has to
+         * move to another one
+         * Allocates n Ts from the calling thread's arena. If that arena
+         * cannot hold them, the thread takes over the first arena that no
+         * other thread holds and that can, and failing that waits for the
+         * busy ones in turn.
+         * throw a bad_alloc exception, if no arena can hold n Ts
+         */
+        pointer allocate (size_type n)
+        {
+            unsigned& index = home();
+            {
+                std::lock_guard<std::mutex> guard(arenas[index].lock);
+                pointer p = try_arena(arenas[index], n);
+                if (p != nullptr || n == 0)
+                {
+                    return p;
+                }
+            }
+
+            // Idle arenas first, so no other thread is held up
+            for (std::size_t i = 1; i != Arenas; ++i)
+            {
+                unsigned j = (index + i) % Arenas;
+                std::unique_lock<std::mutex> guard(arenas[j].lock, std::try_to_lock);
+                if (guard.owns_lock())
+                {
+                    pointer p = try_arena(arenas[j], n);
+                    if (p != nullptr)
+                    {
+                        index = j;
+                        return p;
+                    }
+                }
+            }
+
+            // Then the busy ones
+            for (std::size_t i = 1; i != Arenas; ++i)
+            {
+                unsigned j = (index + i) % Arenas;
+                std::lock_guard<std::mutex> guard(arenas[j].lock);
+                pointer p = try_arena(arenas[j], n);
+                if (p != nullptr)
+                {
+                    index = j;
+                    return p;
+                }
+            }
+
+            std::bad_alloc e;
+            throw e;
+        }
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void construct (pointer p, const_reference v)
+        {
+            new (p) T(v); // this is correct and exempt
+                          // from the prohibition of new
+        }
+
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Gives the block at p back to the arena it was allocated from. The
+         * thread that allocates from that arena frees straight into it; any
+         * other thread pushes the block onto the arena's remote stack, in
+         * the payload every block has room for, and leaves the coalescing to
+         * the arena's next allocate.
+         * throw an invalid_argument exception, if p is invalid or is already
+         * waiting on a remote stack
+         */
+        void deallocate (pointer p, size_type n)
+        {
+            arena* a = owner(p);
+            char* header = reinterpret_cast<char*>(p) - sizeof(int);
+            int sentinel = 0;
+            if (a != nullptr && a->heap.owns(header))
+            {
+                std::memcpy(&sentinel, header, sizeof(int));
+            }
+            if (sentinel >= 0)
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            if (a != &arenas[home()])
+            {
+                if (set_pending(*a, p, true))
+                {
+                    throw std::invalid_argument("Invalid p pointer");
+                }
+                push_remote(*a, p, n);
+                return;
+            }
+            std::lock_guard<std::mutex> guard(a->lock);
+            if (pending(*a, p))
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            a->heap.deallocate(p, n);
+        }
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void destroy (pointer p)
+        {
+            p->~T(); // this is correct
+        }
+};
+
+#endif // ConcurrentAllocator_h
@@ -0,0 +1,705 @@
+/** @file GrowableAllocator.h
+ * @brief Contains a boundary-tag allocator that grows in chunks mapped from
+ *        the operating system
+ */
+
+// --------------------------------------
+// projects/allocator/GrowableAllocator.h
+// --------------------------------------
+
+#ifndef GrowableAllocator_h
+#define GrowableAllocator_h
+
+// --------
+// includes
+// --------
+
+#include <cstddef>    // ptrdiff_t, size_t
+#include <cstdint>    // SIZE_MAX, uint64_t
+#include <cstdio>     // fprintf
+#include <cstdlib>    // abort
+#include <new>        // bad_alloc, new
+#include <stdexcept>  // invalid_argument
+#include <sys/mman.h> // madvise, mmap, munmap
+#include <unistd.h>   // sysconf
+
+#include "Allocator.h" // ALLOCATOR_CHECK
+
+// -----------------
+// GrowableAllocator
+// -----------------
+
+/**
+ * The boundary-tag design of Allocator, with tags as wide as a pointer, over
+ * a list of chunks mapped from the operating system as they are needed
+ * instead of one inline char a[N]. Each chunk is at least chunk_size bytes,
+ * or big enough for the request that needed it, and holds its blocks
+ * between two fences that coalescing never crosses. A chunk that becomes
+ * entirely free is unmapped, unless it is the only one. Mapping is lazy, so
+ * a chunk costs page faults only for the pages its blocks touch.
+ *
+ * Payloads start at a multiple of alignof(T), or of the tag size if that is
+ * larger: the first block of a chunk is padded to start there, and every
+ * block, tags included, is a multiple of that size. Payloads are at least
+ * two pointers, which hold the size class links while the block is free.
+ * Free blocks are kept in one size class per power of two and found with
+ * the same good fit as Allocator's GoodFit.
+ */
+template <typename T>
+class GrowableAllocator
+{
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+    public:
+        // -----------
+        // operator ==
+        // -----------
+
+        /**
+         * Every GrowableAllocator owns its own chunks, so only an allocator
+         * can deallocate what it allocated
+         */
+        friend bool operator == (const GrowableAllocator& lhs, const GrowableAllocator& rhs)
+        {
+            return &lhs == &rhs;
+        }
+
+        // -----------
+        // operator !=
+        // -----------
+
+        friend bool operator != (const GrowableAllocator& lhs, const GrowableAllocator& rhs)
+        {
+            return !(lhs == rhs);
+        }
+
+    private:
+        // ----
+        // data
+        // ----
+
+        /**
+         * A tag is the payload size of a free block, minus the payload size
+         * of a busy block, or 0 for a fence
+         */
+        typedef std::ptrdiff_t tag;
+
+        /**
+         * The start of every mapping. The first block starts at offset
+         * first, and the words before it and at the end of the mapping are
+         * its fences.
+         */
+        struct chunk
+        {
+            chunk*      next;
+            chunk*      prev;
+            std::size_t bytes; // mapped, this header included
+        };
+
+        static_assert(alignof(T) <= 4096, "T must not be aligned past a page");
+
+        /**
+         * A payload starts word bytes into its block, so a block whose
+         * offset into its chunk is word short of a multiple of align, and
+         * whose size is a multiple of align, keeps the next one aligned too
+         */
+        static const std::size_t word        = sizeof(tag);
+        static const std::size_t align       = alignof(T) > word ? alignof(T) : word;
+        static const std::size_t first       = (sizeof(chunk) + 2 * word + align - 1) / align * align - word;
+        static const std::size_t min_payload = (2 * sizeof(char*) + 2 * word + align - 1) / align * align - 2 * word;
+        static const int         classes     = 64;
+
+        chunk*        chunk_list;
+        std::size_t   chunk_count;
+        std::size_t   mapped_bytes;
+        std::size_t   chunk_size;
+        std::size_t   ceiling;
+        bool          huge_pages;
+        char*         bins[classes];
+        std::uint64_t bitmap;
+
+        #if ALLOCATOR_CHECK >= 2
+        std::size_t unchecked;
+        #endif
+
+        // ----
+        // tags
+        // ----
+
+        static tag& tag_at (char* p)
+        {
+            return *reinterpret_cast<tag*>(p);
+        }
+
+        static tag tag_at (const char* p)
+        {
+            return *reinterpret_cast<const tag*>(p);
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The end tag of the block whose beginning tag is at block
+         */
+        static char* end_of (char* block)
+        {
+            tag t = tag_at(block);
+            return block + word + (t < 0 ? -t : t);
+        }
+
+        static char*& next_free (char* block)
+        {
+            return *reinterpret_cast<char**>(block + word);
+        }
+
+        static char*& prev_free (char* block)
+        {
+            return *reinterpret_cast<char**>(block + 2 * word);
+        }
+
+        static chunk* chunk_of_first (char* block)
+        {
+            return reinterpret_cast<chunk*>(block - first);
+        }
+
+        // -----
+        // valid
+        // -----
+
+        FRIEND_TEST(TestGrowable, growable_5);
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Whether the block at block has matching tags, is not next to
+         * another free block, and, if free, is linked where its neighbours
+         * in its size class say
+         */
+        bool valid_block (char* block) const
+        {
+            tag t = tag_at(block);
+            if (t == 0 || tag_at(end_of(block)) != t)
+            {
+                return false;
+            }
+            tag before = tag_at(block - word);
+            tag after  = tag_at(end_of(block) + word);
+            if (t > 0 && (before > 0 || after > 0))
+            {
+                return false;
+            }
+            if (t > 0)
+            {
+                char* next = next_free(block);
+                char* prev = prev_free(block);
+                if ((next != nullptr && prev_free(next) != block) ||
+                    (prev != nullptr && next_free(prev) != block) ||
+                    (prev == nullptr && bins[size_class(t)] != block))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * Whether every chunk is a run of valid blocks between its fences,
+         * and every size class holds exactly the free blocks of its sizes
+         */
+        bool valid () const
+        {
+            std::size_t free_blocks = 0;
+            for (chunk* c = chunk_list; c != nullptr; c = c->next)
+            {
+                char* begin = reinterpret_cast<char*>(c);
+                char* end   = begin + c->bytes - word;
+                char* block = begin + first;
+                if (tag_at(block - word) != 0 || tag_at(end) != 0)
+                {
+                    return false;
+                }
+                while (block != end)
+                {
+                    if (block > end || !valid_block(block))
+                    {
+                        return false;
+                    }
+                    free_blocks += tag_at(block) > 0;
+                    block = end_of(block) + word;
+                }
+            }
+            for (int i = 0; i != classes; ++i)
+            {
+                if ((bins[i] != nullptr) != ((bitmap >> i) & 1))
+                {
+                    return false;
+                }
+                for (char* block = bins[i]; block != nullptr; block = next_free(block))
+                {
+                    if (size_class(tag_at(block)) != i || free_blocks-- == 0)
+                    {
+                        return false;
+                    }
+                }
+            }
+            return free_blocks == 0;
+        }
+
+        /**
+         * Runs the checks ALLOCATOR_CHECK asks for on a block the caller has
+         * just changed, and aborts if they fail
+         */
+        void checked (char* block)
+        {
+            #if ALLOCATOR_CHECK >= 1
+            if (!valid_block(block))
+            {
+                std::fprintf(stderr, "GrowableAllocator: block at %p is corrupt\n",
+                             static_cast<void*>(block));
+                std::abort();
+            }
+            #endif
+            #if ALLOCATOR_CHECK >= 2
+            if (++unchecked == ALLOCATOR_CHECK_PERIOD)
+            {
+                unchecked = 0;
+                if (!valid())
+                {
+                    std::fprintf(stderr, "GrowableAllocator: heap at %p is corrupt\n",
+                                 static_cast<void*>(this));
+                    std::abort();
+                }
+            }
+            #endif
+            (void) block;
+        }
+
+        // ------------
+        // size classes
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * floor(log2(size)), the class a free block of size belongs in
+         */
+        static int size_class (std::size_t size)
+        {
+            return 63 - __builtin_clzll(static_cast<unsigned long long>(size));
+        }
+
+        void insert_free (char* block)
+        {
+            int c = size_class(tag_at(block));
+            next_free(block) = bins[c];
+            prev_free(block) = nullptr;
+            if (bins[c] != nullptr)
+            {
+                prev_free(bins[c]) = block;
+            }
+            bins[c] = block;
+            bitmap |= std::uint64_t(1) << c;
+        }
+
+        void remove_free (char* block)
+        {
+            int c = size_class(tag_at(block));
+            char* next = next_free(block);
+            char* prev = prev_free(block);
+            if (next != nullptr)
+            {
+                prev_free(next) = prev;
+            }
+            if (prev != nullptr)
+            {
+                next_free(prev) = next;
+            }
+            else
+            {
+                bins[c] = next;
+                if (next == nullptr)
+                {
+                    bitmap &= ~(std::uint64_t(1) << c);
+                }
+            }
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time, unless only the request's own class can hold it
+         * A free block that holds bytes: the first one in the first
+         * non-empty class above the request's, where every block fits, or
+         * failing that one from the request's own class
+         * @return its beginning tag, or nullptr
+         */
+        char* find_free (std::size_t bytes) const
+        {
+            int c = size_class(bytes);
+            int above = (bytes & (bytes - 1)) == 0 ? c : c + 1;
+            std::uint64_t map = above < classes ? bitmap & (~std::uint64_t(0) << above) : 0;
+            if (map != 0)
+            {
+                return bins[__builtin_ctzll(map)];
+            }
+            for (char* block = bins[c]; block != nullptr; block = next_free(block))
+            {
+                if (static_cast<std::size_t>(tag_at(block)) >= bytes)
+                {
+                    return block;
+                }
+            }
+            return nullptr;
+        }
+
+        // ------
+        // chunks
+        // ------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The size mappings are rounded to: 2 MB with huge pages, otherwise
+         * the page size
+         */
+        std::size_t granule () const
+        {
+            return huge_pages ? std::size_t(1) << 21
+                              : static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Maps a chunk that holds a free block of at least bytes, and puts
+         * that block in its size class
+         * @return false if the ceiling or the operating system refuses
+         */
+        bool map_chunk (std::size_t bytes)
+        {
+            std::size_t g    = granule();
+            std::size_t need = first + bytes + 3 * word;
+            std::size_t size = need > chunk_size ? need : chunk_size;
+            size = (size + g - 1) / g * g;
+            if (size < need || size > ceiling - mapped_bytes)
+            {
+                return false;
+            }
+
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+            void* m = MAP_FAILED;
+            #ifdef MAP_HUGETLB
+            if (huge_pages)
+            {
+                // Reserved up front, so that touching a page cannot fail
+                m = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+            }
+            #endif
+            if (m == MAP_FAILED)
+            {
+                // No reserved huge pages; ask for transparent ones instead
+                m = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1, 0);
+                if (m == MAP_FAILED)
+                {
+                    return false;
+                }
+                #ifdef MADV_HUGEPAGE
+                if (huge_pages)
+                {
+                    madvise(m, size, MADV_HUGEPAGE);
+                }
+                #endif
+            }
+
+            chunk* c = static_cast<chunk*>(m);
+            c->next  = chunk_list;
+            c->prev  = nullptr;
+            c->bytes = size;
+            if (chunk_list != nullptr)
+            {
+                chunk_list->prev = c;
+            }
+            chunk_list = c;
+            ++chunk_count;
+            mapped_bytes += size;
+
+            char* block = reinterpret_cast<char*>(c) + first;
+            char* end   = reinterpret_cast<char*>(c) + size - word;
+            tag   free  = end - block - 2 * word;
+            tag_at(block - word)      = 0;
+            tag_at(block)             = free;
+            tag_at(end - word)        = free;
+            tag_at(end)               = 0;
+            insert_free(block);
+            checked(block);
+            return true;
+        }
+
+        void unmap_chunk (chunk* c)
+        {
+            if (c->prev != nullptr)
+            {
+                c->prev->next = c->next;
+            }
+            else
+            {
+                chunk_list = c->next;
+            }
+            if (c->next != nullptr)
+            {
+                c->next->prev = c->prev;
+            }
+            --chunk_count;
+            mapped_bytes -= c->bytes;
+            munmap(c, c->bytes);
+        }
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Maps nothing until the first allocate
+         * @param chunk_size the least size of a chunk, rounded up to the page
+         *                   size, or to 2 MB with huge pages
+         * @param ceiling the most bytes that may be mapped at once
+         * @param huge_pages whether to map chunks with huge pages, reserved
+         *                   ones if there are any and transparent ones
+         *                   otherwise
+         */
+        explicit GrowableAllocator (std::size_t chunk_size = std::size_t(1) << 26,
+                                    std::size_t ceiling    = SIZE_MAX,
+                                    bool        huge_pages = false) :
+            chunk_list(nullptr),
+            chunk_count(0),
+            mapped_bytes(0),
+            chunk_size(chunk_size),
+            ceiling(ceiling),
+            huge_pages(huge_pages),
+            bitmap(0)
+        {
+            for (int i = 0; i != classes; ++i)
+            {
+                bins[i] = nullptr;
+            }
+            #if ALLOCATOR_CHECK >= 2
+            unchecked = 0;
+            #endif
+        }
+
+        GrowableAllocator (const GrowableAllocator&) = delete;
+        GrowableAllocator& operator = (const GrowableAllocator&) = delete;
+
+        /**
+         * O(1) in space
+         * O(chunks) in time
+         * Unmaps every chunk
+         */
+        ~GrowableAllocator ()
+        {
+            while (chunk_list != nullptr)
+            {
+                unmap_chunk(chunk_list);
+            }
+        }
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time, plus a mapping when no chunk has room
+         * Allocates at least enough space for n Ts, splitting the block found
+         * if what is left can be a block of its own
+         * throw a bad_alloc exception, if mapping another chunk for n Ts
+         * would pass the ceiling or the operating system refuses it
+         */
+        pointer allocate (size_type n)
+        {
+            if (n == 0)
+            {
+                return nullptr;
+            }
+            if (n > (SIZE_MAX / 2 - first) / sizeof(T))
+            {
+                std::bad_alloc e;
+                throw e;
+            }
+            std::size_t bytes = (n * sizeof(T) + 2 * word + align - 1) / align * align - 2 * word;
+            if (bytes < min_payload)
+            {
+                bytes = min_payload;
+            }
+
+            char* block = find_free(bytes);
+            if (block == nullptr)
+            {
+                if (!map_chunk(bytes))
+                {
+                    std::bad_alloc e;
+                    throw e;
+                }
+                block = find_free(bytes);
+            }
+
+            remove_free(block);
+            std::size_t size = tag_at(block);
+            if (size - bytes >= min_payload + 2 * word)
+            {
+                char* rest = block + bytes + 2 * word;
+                tag   left = size - bytes - 2 * word;
+                tag_at(rest)               = left;
+                tag_at(rest + word + left) = left;
+                insert_free(rest);
+                size = bytes;
+            }
+            tag_at(block)               = -static_cast<tag>(size);
+            tag_at(block + word + size) = -static_cast<tag>(size);
+
+            checked(block);
+            return reinterpret_cast<pointer>(block + word);
+        }
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void construct (pointer p, const_reference v)
+        {
+            new (p) T(v); // this is correct and exempt
+                          // from the prohibition of new
+        }
+
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Frees the block at p, coalesced with its free neighbours in the
+         * same chunk. If that leaves its chunk entirely free and there are
+         * others, the chunk is unmapped.
+         * throw an invalid_argument exception, if p is null or not a busy
+         * block
+         */
+        void deallocate (pointer p, size_type)
+        {
+            if (p == nullptr)
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            char* block = reinterpret_cast<char*>(p) - word;
+            tag   t     = tag_at(block);
+            if (t >= 0 || tag_at(block + word - t) != t)
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+
+            char* begin = block;
+            char* end   = block + word - t;
+            tag before = tag_at(begin - word);
+            if (before > 0)
+            {
+                begin -= before + 2 * word;
+                remove_free(begin);
+            }
+            tag after = tag_at(end + word);
+            if (after > 0)
+            {
+                remove_free(end + word);
+                end += after + 2 * word;
+            }
+
+            // A chunk with nothing in use goes back to the operating system
+            if (tag_at(begin - word) == 0 && tag_at(end + word) == 0 &&
+                chunk_count > 1)
+            {
+                unmap_chunk(chunk_of_first(begin));
+                return;
+            }
+
+            tag size = end - begin - word;
+            tag_at(begin) = size;
+            tag_at(end)   = size;
+            insert_free(begin);
+            checked(begin);
+        }
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void destroy (pointer p)
+        {
+            p->~T(); // this is correct
+        }
+
+        // ------
+        // chunks
+        // ------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The number of chunks mapped
+         */
+        std::size_t chunks () const
+        {
+            return chunk_count;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The bytes mapped for all the chunks
+         */
+        std::size_t mapped () const
+        {
+            return mapped_bytes;
+        }
+
+        // -----
+        // check
+        // -----
+
+        /**
+         * O(1) in space
+         * O(n) in time
+         * Sweeps every chunk, as ALLOCATOR_CHECK 2 does periodically
+         * @return true if the heap is consistent
+         */
+        bool check () const
+        {
+            return valid();
+        }
+};
+
+#endif // GrowableAllocator_h
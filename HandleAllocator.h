@@ -0,0 +1,382 @@
+/** @file HandleAllocator.h
+ * @brief Contains an allocator that hands out handles instead of pointers,
+ *        so that it can move blocks to compact its heap
+ */
+
+// ------------------------------------
+// projects/allocator/HandleAllocator.h
+// ------------------------------------
+
+#ifndef HandleAllocator_h
+#define HandleAllocator_h
+
+// --------
+// includes
+// --------
+
+#include <cstddef>   // ptrdiff_t, size_t
+#include <cstring>   // memcpy
+#include <limits>    // numeric_limits
+#include <new>       // bad_alloc
+#include <stdexcept> // invalid_argument
+
+#include "Allocator.h"
+
+// ---------------
+// HandleAllocator
+// ---------------
+
+/**
+ * An Allocator<T, N, Policy> whose blocks are named by handles, small ints
+ * into a table of Handles slots, instead of by pointers. A caller pins a
+ * handle to get a pointer to its Ts, which stays valid until the handle is
+ * unpinned as often as it was pinned; blocks that are not pinned may move.
+ *
+ * compact slides unpinned blocks towards the front of the heap a few at a
+ * time, so that the free space between them runs together at the back. It
+ * keeps its place between calls, so a long-running program can compact in
+ * slices of bounded cost, say once per frame or request. allocate compacts
+ * the whole heap before it gives up. Like reallocate, compaction moves the
+ * Ts as bytes, so T must be trivially copyable.
+ *
+ * Every block starts with the handle that names it, in the first header Ts,
+ * which is how the compactor finds the slot to update.
+ */
+template <typename T, std::size_t N, std::size_t Handles = 256, typename Policy = GoodFit>
+class HandleAllocator
+{
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+        typedef int               handle;
+
+        typedef Allocator<T, N, Policy> allocator_type;
+
+    private:
+        // ----
+        // data
+        // ----
+
+        /**
+         * The Ts in front of every block that hold its handle
+         */
+        static const size_type header = (sizeof(int) + sizeof(T) - 1) / sizeof(T);
+
+        /**
+         * What a handle names: the block's first T after the header and its
+         * size, or, for a handle not in use, the next one that is not
+         */
+        struct slot
+        {
+            pointer   p;    // nullptr if the handle is not in use
+            size_type n;
+            int       pins;
+            handle    next; // the next free handle, or -1
+        };
+
+        allocator_type heap;
+        slot           slots[Handles];
+        handle         free_slots; // the first free handle, or -1
+        int            cursor;     // the offset of the block compact resumes at
+
+        // ----
+        // used
+        // ----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The slot h names
+         * throw an invalid_argument exception, if h is not in use
+         */
+        slot& used (handle h)
+        {
+            if (h < 0 || static_cast<size_type>(h) >= Handles || slots[h].p == nullptr)
+            {
+                throw std::invalid_argument("Invalid h handle");
+            }
+            return slots[h];
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The handle stored at the front of the block at offset block
+         */
+        handle owner (int block) const
+        {
+            return heap[block + sizeof(int)];
+        }
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(Handles) in time
+         * throw a bad_alloc exception, if N is less than sizeof(T) +
+         * (2 * sizeof(int))
+         */
+        HandleAllocator () :
+            heap(),
+            free_slots(0),
+            cursor(0)
+        {
+            for (size_type i = 0; i != Handles; ++i)
+            {
+                slots[i].p    = nullptr;
+                slots[i].n    = 0;
+                slots[i].pins = 0;
+                slots[i].next = i + 1 == Handles ? -1 : static_cast<handle>(i + 1);
+            }
+        }
+
+        HandleAllocator (const HandleAllocator&) = delete;
+        HandleAllocator& operator = (const HandleAllocator&) = delete;
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time with GoodFit, O(N) when it has to compact
+         * Allocates n Ts, unpinned. If no free block can hold them, the
+         * whole heap is compacted first.
+         * throw a bad_alloc exception, if there is no free handle, or no
+         * room for n Ts even after compacting
+         * @return the handle of the block
+         */
+        handle allocate (size_type n)
+        {
+            if (free_slots == -1)
+            {
+                std::bad_alloc e;
+                throw e;
+            }
+            pointer p;
+            try
+            {
+                p = heap.allocate(n + header);
+            }
+            catch (std::bad_alloc&)
+            {
+                compact();
+                p = heap.allocate(n + header);
+            }
+
+            handle h = free_slots;
+            slot&  s = slots[h];
+            free_slots = s.next;
+            std::memcpy(p, &h, sizeof(handle));
+            s.p    = p + header;
+            s.n    = n;
+            s.pins = 0;
+            return h;
+        }
+
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Frees the block h names, and h with it
+         * throw an invalid_argument exception, if h is not in use or is
+         * pinned
+         */
+        void deallocate (handle h, size_type n)
+        {
+            (void) n;
+            slot& s = used(h);
+            if (s.pins != 0)
+            {
+                throw std::invalid_argument("Invalid h handle");
+            }
+
+            // The compactor's place must stay the start of a block, which
+            // it is not if it is this block or the one after and they are
+            // about to be coalesced into the free block before
+            pointer p     = s.p - header;
+            int     block = static_cast<int>(reinterpret_cast<const char*>(p) -
+                                             reinterpret_cast<const char*>(&arena()[0])) - sizeof(int);
+            int     after = block - arena()[block] + 2 * sizeof(int);
+            if (cursor == block || cursor == after)
+            {
+                int before = block == 0 ? 0 : arena()[block - sizeof(int)];
+                cursor = before > 0 ? block - before - 2 * static_cast<int>(sizeof(int)) : block;
+            }
+            heap.deallocate(p, s.n + header);
+
+            s.p        = nullptr;
+            s.next     = free_slots;
+            free_slots = h;
+        }
+
+        // ---
+        // pin
+        // ---
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Keeps the block h names where it is until a matching unpin
+         * throw an invalid_argument exception, if h is not in use
+         * @return the Ts of the block
+         */
+        pointer pin (handle h)
+        {
+            slot& s = used(h);
+            ++s.pins;
+            return s.p;
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Undoes one pin; the pointer it returned may then go stale
+         * throw an invalid_argument exception, if h is not in use or not
+         * pinned
+         */
+        void unpin (handle h)
+        {
+            slot& s = used(h);
+            if (s.pins == 0)
+            {
+                throw std::invalid_argument("Invalid h handle");
+            }
+            --s.pins;
+        }
+
+        // -------
+        // compact
+        // -------
+
+        /**
+         * O(1) in space
+         * O(budget) in time
+         * Carries on compacting from where the last call stopped, sliding
+         * every unpinned block that has free space before it down into that
+         * space, until budget bytes have been walked over or moved. A block
+         * bigger than what is left of budget waits for the next call,
+         * unless it would be the first to move in this one, so every call
+         * makes progress. A pinned block stays put, and the free space
+         * before it with it.
+         * @param budget about how many bytes this call may touch
+         * @return true if this call reached the end of the heap, after which
+         *         the next starts again at the front
+         */
+        bool compact (size_type budget)
+        {
+            size_type spent = 0;
+            bool      moved = false;
+            while (static_cast<size_type>(cursor) < N)
+            {
+                if (spent >= budget)
+                {
+                    return false;
+                }
+                int sentinel = arena()[cursor];
+                spent += 2 * sizeof(int);
+                if (sentinel < 0 && cursor != 0 && arena()[cursor - sizeof(int)] > 0)
+                {
+                    slot& s = slots[owner(cursor)];
+                    if (s.pins == 0)
+                    {
+                        size_type bytes = (s.n + header) * sizeof(T);
+                        if (moved && spent + bytes > budget)
+                        {
+                            return false;
+                        }
+                        pointer p = heap.slide(s.p - header, s.n + header);
+                        cursor   -= static_cast<int>(reinterpret_cast<char*>(s.p - header) -
+                                                     reinterpret_cast<char*>(p));
+                        sentinel  = arena()[cursor];
+                        s.p       = p + header;
+                        spent    += bytes;
+                        moved     = true;
+                    }
+                }
+                cursor += (sentinel < 0 ? -sentinel : sentinel) + 2 * sizeof(int);
+            }
+            cursor = 0;
+            return true;
+        }
+
+        /**
+         * O(1) in space
+         * O(N) in time
+         * Compacts the whole heap, from the front
+         */
+        void compact ()
+        {
+            cursor = 0;
+            compact(std::numeric_limits<size_type>::max());
+        }
+
+        // -----
+        // arena
+        // -----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The heap the blocks live in, to look at
+         */
+        const allocator_type& arena () const
+        {
+            return heap;
+        }
+
+        // -----
+        // check
+        // -----
+
+        /**
+         * O(1) in space
+         * O(N + Handles) in time
+         * Whether the heap is consistent and every handle in use names a
+         * busy block that names it back
+         */
+        bool check () const
+        {
+            if (!heap.check() || cursor < 0 || static_cast<size_type>(cursor) > N)
+            {
+                return false;
+            }
+            for (size_type i = 0; i != Handles; ++i)
+            {
+                const slot& s = slots[i];
+                if (s.p == nullptr)
+                {
+                    continue;
+                }
+                const pointer p = s.p - header;
+                handle h;
+                std::memcpy(&h, p, sizeof(handle));
+                if (!heap.owns(p) || h != static_cast<handle>(i) || s.pins < 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+};
+
+#endif // HandleAllocator_h
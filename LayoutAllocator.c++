@@ -0,0 +1,461 @@
+/** @file LayoutAllocator.c++
+ * @brief This file replays a trace file into an Allocator and draws its heap
+ *
+ * LayoutAllocator [--heap 64K|1M|16M|256M] [--policy name] [--frames k]
+ *                 [--columns c] file
+ *
+ * replays file, written by Allocator's ALLOCATOR_RECORD mode or by
+ * BenchAllocator --write, into an Allocator<char, N, Policy>, 1M and GoodFit
+ * by default, and prints:
+ * - the sentinel layout of a[] at k evenly spaced points, 16 by default, one
+ *   line of c columns each, 64 by default,
+ * - the points where fragmentation was worst, with the layout and the free
+ *   block size distribution at each,
+ * - the free block size distribution at the end.
+ */
+
+// --------------------------------------
+// projects/allocator/LayoutAllocator.c++
+// --------------------------------------
+
+// --------
+// includes
+// --------
+
+#include <algorithm>     // max, min, sort
+#include <cstdio>        // printf
+#include <cstdlib>       // atoi
+#include <cstring>       // strcmp
+#include <exception>     // exception
+#include <memory>        // unique_ptr
+#include <new>           // bad_alloc
+#include <set>           // set
+#include <string>        // string
+#include <unordered_map> // unordered_map
+#include <utility>       // make_pair, pair
+#include <vector>        // vector
+
+#include "Allocator.h"
+#include "AllocatorTrace.h"
+
+#if !ALLOCATOR_STATS
+    #error "LayoutAllocator needs -DALLOCATOR_STATS=1"
+#endif
+
+// ---------
+// constants
+// ---------
+
+/**
+ * Number of worst fragmentation points shown
+ */
+const std::size_t worst_points = 5;
+
+// -------
+// options
+// -------
+
+/**
+ * What the command line asked for
+ */
+struct options
+{
+    std::string heap;
+    std::string policy;
+    std::size_t frames;
+    std::size_t columns;
+    const char* path;
+};
+
+// ------
+// layout
+// ------
+
+/**
+ * O(c) in space
+ * O(n + c) in time
+ * Draws a[] as columns characters, each covering N / columns bytes: '#' if
+ * all of them are in busy blocks or sentinels, '+' if at least half, '-'
+ * if some, '.' if none
+ * @param x the allocator to draw, read through its sentinels
+ * @param columns the width of the drawing
+ */
+template <std::size_t N, typename P>
+std::string layout (const Allocator<char, N, P>& x, std::size_t columns)
+{
+    std::vector<double> busy(columns, 0);
+    const double width = static_cast<double>(N) / columns;
+    auto mark = [&busy, width, columns] (std::size_t b, std::size_t e)
+    {
+        while (b < e)
+        {
+            std::size_t c    = std::min<std::size_t>(b / width, columns - 1);
+            std::size_t stop = std::min<std::size_t>(e, (c + 1) * width);
+            busy[c] += stop - b;
+            b = stop > b ? stop : e;
+        }
+    };
+
+    // Busy blocks count whole, free blocks only for their sentinels
+    std::size_t i = 0;
+    while (i < N)
+    {
+        int sentinel = x[i];
+        std::size_t end = i + (sentinel < 0 ? -sentinel : sentinel) + 2 * sizeof(int);
+        if (sentinel < 0)
+        {
+            mark(i, end);
+        }
+        else
+        {
+            mark(i, i + sizeof(int));
+            mark(end - sizeof(int), end);
+        }
+        i = end;
+    }
+
+    std::string s(columns, '.');
+    for (std::size_t c = 0; c != columns; ++c)
+    {
+        double f = busy[c] / width;
+        s[c] = f >= 1 - 1e-9 ? '#' : f >= 0.5 ? '+' : f > 0 ? '-' : '.';
+    }
+    return s;
+}
+
+// ------------
+// distribution
+// ------------
+
+/**
+ * O(1) in space
+ * O(n) in time
+ * Prints the free blocks of x by floor(log2(payload size)): how many there
+ * are and how many bytes they hold, with a bar scaled to the bytes
+ */
+template <std::size_t N, typename P>
+void distribution (const Allocator<char, N, P>& x)
+{
+    std::size_t count[32] = {};
+    std::size_t bytes[32] = {};
+    std::size_t total     = 0;
+    std::size_t i         = 0;
+    while (i < N)
+    {
+        int sentinel = x[i];
+        if (sentinel > 0)
+        {
+            ++count[allocator_log2(sentinel)];
+            bytes[allocator_log2(sentinel)] += sentinel;
+            total += sentinel;
+        }
+        i += (sentinel < 0 ? -sentinel : sentinel) + 2 * sizeof(int);
+    }
+
+    std::printf("    %-17s %8s %10s\n", "free size", "blocks", "bytes");
+    for (int k = 0; k != 32; ++k)
+    {
+        if (count[k] == 0)
+        {
+            continue;
+        }
+        std::size_t bar = total == 0 ? 0 : 40 * bytes[k] / total;
+        std::printf("    %8zu-%-8zu %8zu %10zu %s\n", std::size_t(1) << k,
+                    (std::size_t(2) << k) - 1, count[k], bytes[k],
+                    std::string(bar, '*').c_str());
+    }
+}
+
+// ------
+// replay
+// ------
+
+/**
+ * Replays a trace into an Allocator<char, N, P> one record at a time.
+ * Deallocates of blocks the trace never allocated, or whose allocate
+ * failed, are skipped; blocks are asked for max(1, bytes) chars.
+ */
+template <std::size_t N, typename P>
+class replay
+{
+    private:
+        typedef Allocator<char, N, P> allocator_type;
+
+        const std::vector<trace_record>&                                    trace;
+        std::unique_ptr<allocator_type>                                     x;
+        std::unordered_map<std::uint64_t, std::pair<char*, std::size_t> > live;
+
+    public:
+        std::size_t next;
+        std::size_t failed;
+
+        explicit replay (const std::vector<trace_record>& t) :
+            trace(t),
+            x(new allocator_type()),
+            live(),
+            next(0),
+            failed(0)
+        {}
+
+        const allocator_type& heap () const
+        {
+            return *x;
+        }
+
+        /**
+         * Replays the next record
+         */
+        void step ()
+        {
+            const trace_record& r = trace[next++];
+            if (r.op == trace_allocate)
+            {
+                std::size_t n = std::max<std::size_t>(1, r.bytes);
+                try
+                {
+                    live[r.id] = std::make_pair(x->allocate(n), n);
+                }
+                catch (std::bad_alloc&)
+                {
+                    ++failed;
+                    live.erase(r.id);
+                }
+            }
+            else if (live.count(r.id) != 0)
+            {
+                x->deallocate(live[r.id].first, live[r.id].second);
+                live.erase(r.id);
+            }
+        }
+
+        /**
+         * Replays up to, not including, record end
+         */
+        void run_to (std::size_t end)
+        {
+            while (next < end)
+            {
+                step();
+            }
+        }
+};
+
+// -------
+// analyze
+// -------
+
+/**
+ * Prints one line of the layout after the records replayed so far
+ */
+template <std::size_t N, typename P>
+void frame (const replay<N, P>& r, const std::vector<trace_record>& trace,
+            std::size_t columns)
+{
+    AllocatorStats s = r.heap().stats();
+    std::uint64_t time = r.next == 0 ? 0 : trace[r.next - 1].time;
+    std::printf("%9zu %10.3f %6.1f%% |%s|\n", r.next, time / 1e6,
+                100 * s.fragmentation(), layout(r.heap(), columns).c_str());
+}
+
+/**
+ * Replays the trace into Allocator<char, N, P> and prints everything
+ */
+template <std::size_t N, typename P>
+void analyze (const std::vector<trace_record>& trace, const options& o)
+{
+    // Fragmentation after every record, and the summary
+    std::vector<double> fragmentation;
+    fragmentation.reserve(trace.size());
+    std::set<std::uint16_t> threads;
+    replay<N, P> r(trace);
+    while (r.next != trace.size())
+    {
+        threads.insert(trace[r.next].thread);
+        r.step();
+        fragmentation.push_back(r.heap().stats().fragmentation());
+    }
+    AllocatorStats s = r.heap().stats();
+    std::printf("%s: %zu records from %zu threads into %s %s, %zu allocations "
+                "failed, %zu bytes live at most\n\n", o.path, trace.size(),
+                threads.size(), o.heap.c_str(), o.policy.c_str(), r.failed,
+                s.high_water);
+
+    // The layout over time
+    std::printf("%9s %10s %7s  ('#' busy, '+' half busy, '-' some busy, '.' free)\n",
+                "record", "ms", "frag");
+    replay<N, P> over_time(trace);
+    for (std::size_t k = 1; k <= o.frames; ++k)
+    {
+        over_time.run_to(trace.size() * k / o.frames);
+        frame(over_time, trace, o.columns);
+    }
+
+    // The worst points, at least a twentieth of the trace apart
+    std::vector<std::size_t> order(fragmentation.size());
+    for (std::size_t i = 0; i != order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&fragmentation] (std::size_t a, std::size_t b)
+    {
+        return fragmentation[a] > fragmentation[b] ||
+               (fragmentation[a] == fragmentation[b] && a < b);
+    });
+    std::size_t apart = std::max<std::size_t>(1, trace.size() / 20);
+    std::vector<std::size_t> worst;
+    for (std::size_t i : order)
+    {
+        if (worst.size() == worst_points || fragmentation[i] == 0)
+        {
+            break;
+        }
+        bool far = true;
+        for (std::size_t w : worst)
+        {
+            far = far && (i > w ? i - w : w - i) >= apart;
+        }
+        if (far)
+        {
+            worst.push_back(i);
+        }
+    }
+    std::sort(worst.begin(), worst.end());
+
+    std::printf("\nworst fragmentation\n");
+    replay<N, P> at_worst(trace);
+    for (std::size_t w : worst)
+    {
+        at_worst.run_to(w + 1);
+        AllocatorStats ws = at_worst.heap().stats();
+        std::printf("\n");
+        frame(at_worst, trace, o.columns);
+        std::printf("    %zu bytes free, largest free block %zu\n", ws.free_bytes,
+                    ws.largest_free);
+        distribution(at_worst.heap());
+    }
+
+    std::printf("\nat the end\n");
+    distribution(r.heap());
+}
+
+// --------
+// dispatch
+// --------
+
+/**
+ * Picks N; false if o.heap is not one of the sizes compiled in
+ */
+template <typename P>
+bool analyze (const std::vector<trace_record>& trace, const options& o)
+{
+    if (o.heap == "64K")
+    {
+        analyze<std::size_t(1) << 16, P>(trace, o);
+    }
+    else if (o.heap == "1M")
+    {
+        analyze<std::size_t(1) << 20, P>(trace, o);
+    }
+    else if (o.heap == "16M")
+    {
+        analyze<std::size_t(1) << 24, P>(trace, o);
+    }
+    else if (o.heap == "256M")
+    {
+        analyze<std::size_t(1) << 28, P>(trace, o);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Picks the policy; false if o.policy or o.heap is unknown
+ */
+bool analyze (const std::vector<trace_record>& trace, const options& o)
+{
+    if (o.policy == "GoodFit")
+    {
+        return analyze<GoodFit>(trace, o);
+    }
+    if (o.policy == "FirstFit")
+    {
+        return analyze<FirstFit>(trace, o);
+    }
+    if (o.policy == "NextFit")
+    {
+        return analyze<NextFit>(trace, o);
+    }
+    if (o.policy == "BestFit")
+    {
+        return analyze<BestFit>(trace, o);
+    }
+    if (o.policy == "WorstFit")
+    {
+        return analyze<WorstFit>(trace, o);
+    }
+    return false;
+}
+
+// ----
+// main
+// ----
+
+int main (int argc, char* argv[])
+{
+    options o = {"1M", "GoodFit", 16, 64, nullptr};
+    for (int i = 1; i != argc; ++i)
+    {
+        if (i + 1 != argc && std::strcmp(argv[i], "--heap") == 0)
+        {
+            o.heap = argv[++i];
+        }
+        else if (i + 1 != argc && std::strcmp(argv[i], "--policy") == 0)
+        {
+            o.policy = argv[++i];
+        }
+        else if (i + 1 != argc && std::strcmp(argv[i], "--frames") == 0)
+        {
+            o.frames = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (i + 1 != argc && std::strcmp(argv[i], "--columns") == 0)
+        {
+            o.columns = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (o.path == nullptr && argv[i][0] != '-')
+        {
+            o.path = argv[i];
+        }
+        else
+        {
+            o.path = nullptr;
+            break;
+        }
+    }
+    if (o.path == nullptr)
+    {
+        std::fprintf(stderr, "usage: %s [--heap 64K|1M|16M|256M] [--policy GoodFit|"
+                     "FirstFit|NextFit|BestFit|WorstFit] [--frames k] [--columns c] "
+                     "file\n", argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        std::vector<trace_record> trace = read_trace(o.path);
+        if (!analyze(trace, o))
+        {
+            std::fprintf(stderr, "unknown heap %s or policy %s\n", o.heap.c_str(),
+                         o.policy.c_str());
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
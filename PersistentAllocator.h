@@ -0,0 +1,509 @@
+/** @file PersistentAllocator.h
+ * @brief Contains an Allocator that lives in a memory-mapped file, a POSIX
+ *        shared memory segment, or any other buffer, so that other
+ *        processes can attach to it
+ */
+
+// ----------------------------------------
+// projects/allocator/PersistentAllocator.h
+// ----------------------------------------
+
+#ifndef PersistentAllocator_h
+#define PersistentAllocator_h
+
+// --------
+// includes
+// --------
+
+#include <cerrno>     // EOWNERDEAD
+#include <cstddef>    // ptrdiff_t, size_t
+#include <cstdint>    // uint32_t, uint64_t, uintptr_t
+#include <fcntl.h>    // O_CREAT, O_RDWR, O_TRUNC
+#include <new>        // new
+#include <pthread.h>  // pthread_mutex_*
+#include <stdexcept>  // invalid_argument, runtime_error
+#include <string>     // string
+#include <sys/mman.h> // mmap, munmap, shm_open
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close, ftruncate
+
+#include "Allocator.h"
+
+// ----------
+// offset_ptr
+// ----------
+
+/**
+ * A pointer to U that stores the distance from itself to its target, so
+ * that it stays valid when the memory holding both is mapped at another
+ * address. Links between objects in a PersistentAllocator must be
+ * offset_ptrs, not plain pointers. The distance 1 stands for nullptr, as a
+ * U cannot start one byte after the offset_ptr that points to it.
+ */
+template <typename U>
+class offset_ptr
+{
+    private:
+        std::ptrdiff_t offset;
+
+        void set (const U* p)
+        {
+            offset = p == nullptr ? 1 : reinterpret_cast<const char*>(p) -
+                                        reinterpret_cast<const char*>(this);
+        }
+
+    public:
+        offset_ptr (U* p = nullptr)
+        {
+            set(p);
+        }
+
+        offset_ptr (const offset_ptr& that)
+        {
+            set(that.get());
+        }
+
+        offset_ptr& operator = (const offset_ptr& that)
+        {
+            set(that.get());
+            return *this;
+        }
+
+        offset_ptr& operator = (U* p)
+        {
+            set(p);
+            return *this;
+        }
+
+        U* get () const
+        {
+            return offset == 1 ? nullptr :
+                   reinterpret_cast<U*>(const_cast<char*>(reinterpret_cast<const char*>(this)) + offset);
+        }
+
+        U& operator * () const
+        {
+            return *get();
+        }
+
+        U* operator -> () const
+        {
+            return get();
+        }
+
+        explicit operator bool () const
+        {
+            return offset != 1;
+        }
+};
+
+// -------------------
+// PersistentAllocator
+// -------------------
+
+/**
+ * Whether a PersistentAllocator builds a new heap or attaches to one that
+ * exists
+ */
+enum persistent_mode
+{
+    persistent_create,
+    persistent_attach
+};
+
+/**
+ * What a named PersistentAllocator is mapped from
+ */
+enum persistent_backing
+{
+    persistent_file, // a path in the file system
+    persistent_shm   // a POSIX shared memory name, such as "/heap"
+};
+
+/**
+ * An Allocator<T, N, Policy> that lives in memory the caller or the
+ * operating system shares, instead of in this object. An Allocator keeps
+ * its blocks, size classes and policy state as offsets into a[], so the
+ * heap can be used wherever the memory is mapped; a small header in front
+ * of it records the layout, a process-shared robust mutex, and the offset
+ * of a root object through which another process finds the rest.
+ *
+ * allocate, deallocate and check take the mutex. Readers that must not see
+ * a half-made change take it too, through lock and unlock. Every process
+ * must be built with the same T, N, Policy, ALLOCATOR_CHECK and
+ * ALLOCATOR_STATS, which attaching checks as far as the layout shows.
+ */
+template <typename T, std::size_t N, typename Policy = GoodFit>
+class PersistentAllocator
+{
+    public:
+        // --------
+        // typedefs
+        // --------
+
+        typedef T                 value_type;
+
+        typedef std::size_t       size_type;
+        typedef std::ptrdiff_t    difference_type;
+
+        typedef       value_type*       pointer;
+        typedef const value_type* const_pointer;
+
+        typedef       value_type&       reference;
+        typedef const value_type& const_reference;
+
+    private:
+        // ----
+        // data
+        // ----
+
+        static const std::uint32_t magic = 0x31485041; // "APH1"
+
+        /**
+         * Everything that is shared
+         */
+        struct segment
+        {
+            std::uint32_t           magic;
+            std::uint32_t           layout; // sizeof(segment)
+            std::uint64_t           n;      // N
+            std::uint64_t           t_size; // sizeof(T)
+            std::ptrdiff_t          root;   // from the segment, or 0 for none
+            pthread_mutex_t         mutex;
+            Allocator<T, N, Policy> heap;
+        };
+
+        segment*    shared;
+        std::size_t mapped_bytes; // 0 if the caller owns the memory
+
+        // ------
+        // create
+        // ------
+
+        /**
+         * Builds a new, empty segment at shared
+         */
+        void create ()
+        {
+            new (&shared->heap) Allocator<T, N, Policy>();
+
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+            int error = pthread_mutex_init(&shared->mutex, &attr);
+            pthread_mutexattr_destroy(&attr);
+            if (error != 0)
+            {
+                throw std::runtime_error("cannot create the heap's mutex");
+            }
+
+            shared->layout = sizeof(segment);
+            shared->n      = N;
+            shared->t_size = sizeof(T);
+            shared->root   = 0;
+            shared->magic  = magic; // last, so a half-made heap is never valid
+        }
+
+        /**
+         * Checks that shared holds a heap of this layout that is consistent,
+         * under the lock so that no other process is halfway through
+         * changing it
+         * throw a runtime_error, if it does not
+         */
+        void attach ()
+        {
+            if (shared->magic  != magic          || shared->layout != sizeof(segment) ||
+                shared->n      != N              || shared->t_size != sizeof(T)       ||
+                !check())
+            {
+                throw std::runtime_error("not a heap of this layout, or corrupt");
+            }
+        }
+
+        /**
+         * Creates or attaches to the segment at memory
+         */
+        void open (void* memory, std::size_t bytes, persistent_mode mode)
+        {
+            if (bytes < sizeof(segment) ||
+                reinterpret_cast<std::uintptr_t>(memory) % alignof(segment) != 0)
+            {
+                throw std::invalid_argument("buffer too small or misaligned");
+            }
+            shared = static_cast<segment*>(memory);
+            if (mode == persistent_create)
+            {
+                create();
+            }
+            else
+            {
+                attach();
+            }
+        }
+
+        void unmap ()
+        {
+            if (mapped_bytes != 0)
+            {
+                munmap(shared, mapped_bytes);
+            }
+        }
+
+    public:
+        // ------------
+        // constructors
+        // ------------
+
+        /**
+         * O(1) in space
+         * O(1) in time to create, O(N) to attach, which checks the heap
+         * Uses bytes of caller-owned memory at buffer, which must outlive
+         * this object and be aligned for the header
+         * throw an invalid_argument exception, if buffer is too small or
+         * misaligned
+         * throw a runtime_error, if attaching finds no valid heap
+         */
+        PersistentAllocator (void* buffer, std::size_t bytes, persistent_mode mode) :
+            shared(nullptr),
+            mapped_bytes(0)
+        {
+            open(buffer, bytes, mode);
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time to create, O(N) to attach, which checks the heap
+         * Maps the file or shared memory object name, creating or truncating
+         * it when creating. The heap outlives this object; a shared memory
+         * object lasts until shm_unlink.
+         * throw a runtime_error, if name cannot be opened or mapped, or if
+         * attaching finds no valid heap
+         */
+        PersistentAllocator (const std::string& name, persistent_mode mode,
+                             persistent_backing backing = persistent_file) :
+            shared(nullptr),
+            mapped_bytes(0)
+        {
+            int flags = mode == persistent_create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR;
+            int fd = backing == persistent_shm ? shm_open(name.c_str(), flags, 0600)
+                                               : ::open(name.c_str(), flags, 0600);
+            if (fd == -1)
+            {
+                throw std::runtime_error("cannot open " + name);
+            }
+
+            struct stat st;
+            bool sized = mode == persistent_create
+                         ? ftruncate(fd, sizeof(segment)) == 0
+                         : fstat(fd, &st) == 0 && st.st_size == static_cast<off_t>(sizeof(segment));
+            void* m = sized ? mmap(nullptr, sizeof(segment), PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, fd, 0)
+                            : MAP_FAILED;
+            close(fd);
+            if (m == MAP_FAILED)
+            {
+                throw std::runtime_error("cannot map " + name);
+            }
+            mapped_bytes = sizeof(segment);
+            try
+            {
+                open(m, sizeof(segment), mode);
+            }
+            catch (...)
+            {
+                unmap();
+                throw;
+            }
+        }
+
+        PersistentAllocator (const PersistentAllocator&) = delete;
+        PersistentAllocator& operator = (const PersistentAllocator&) = delete;
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Unmaps the heap if this object mapped it; the heap itself stays
+         */
+        ~PersistentAllocator ()
+        {
+            unmap();
+        }
+
+        // ----
+        // size
+        // ----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The bytes a buffer must have to hold the heap
+         */
+        static constexpr std::size_t size ()
+        {
+            return sizeof(segment);
+        }
+
+        // ----
+        // lock
+        // ----
+
+        /**
+         * O(1) in space
+         * O(N) in time if the last holder died holding the lock, O(1)
+         * otherwise
+         * Takes the mutex shared by every process attached to the heap. If
+         * its last holder died holding it, the heap is checked and, if it
+         * is consistent, kept.
+         * throw a runtime_error, if the holder died and left the heap corrupt
+         */
+        void lock ()
+        {
+            int error = pthread_mutex_lock(&shared->mutex);
+            if (error == EOWNERDEAD)
+            {
+                if (!shared->heap.check())
+                {
+                    pthread_mutex_unlock(&shared->mutex);
+                    throw std::runtime_error("heap left corrupt by a dead process");
+                }
+                pthread_mutex_consistent(&shared->mutex);
+            }
+            else if (error != 0)
+            {
+                throw std::runtime_error("cannot lock the heap");
+            }
+        }
+
+        void unlock ()
+        {
+            pthread_mutex_unlock(&shared->mutex);
+        }
+
+        // --------
+        // allocate
+        // --------
+
+        /**
+         * O(1) in space
+         * O(1) in time with GoodFit
+         * Allocator::allocate under the lock
+         */
+        pointer allocate (size_type n)
+        {
+            lock();
+            try
+            {
+                pointer p = shared->heap.allocate(n);
+                unlock();
+                return p;
+            }
+            catch (...)
+            {
+                unlock();
+                throw;
+            }
+        }
+
+        // ---------
+        // construct
+        // ---------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void construct (pointer p, const_reference v)
+        {
+            new (p) T(v); // this is correct and exempt
+                          // from the prohibition of new
+        }
+
+        // ----------
+        // deallocate
+        // ----------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Allocator::deallocate under the lock
+         */
+        void deallocate (pointer p, size_type n)
+        {
+            lock();
+            try
+            {
+                shared->heap.deallocate(p, n);
+                unlock();
+            }
+            catch (...)
+            {
+                unlock();
+                throw;
+            }
+        }
+
+        // -------
+        // destroy
+        // -------
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         */
+        void destroy (pointer p)
+        {
+            p->~T(); // this is correct
+        }
+
+        // ----
+        // root
+        // ----
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * The object another process starts from, or nullptr
+         */
+        pointer root () const
+        {
+            return shared->root == 0 ? nullptr :
+                   reinterpret_cast<pointer>(reinterpret_cast<char*>(shared) + shared->root);
+        }
+
+        /**
+         * O(1) in space
+         * O(1) in time
+         * Records p, which must come from this heap, as the root
+         * throw an invalid_argument exception, if p is not in the heap
+         */
+        void set_root (pointer p)
+        {
+            if (p != nullptr && !shared->heap.owns(p))
+            {
+                throw std::invalid_argument("Invalid p pointer");
+            }
+            shared->root = p == nullptr ? 0 : reinterpret_cast<char*>(p) -
+                                              reinterpret_cast<char*>(shared);
+        }
+
+        // -----
+        // check
+        // -----
+
+        /**
+         * O(1) in space
+         * O(N) in time
+         * Allocator::check under the lock
+         * throw a runtime_error, if the lock cannot be taken
+         */
+        bool check ()
+        {
+            lock();
+            bool valid = shared->heap.check();
+            unlock();
+            return valid;
+        }
+};
+
+#endif // PersistentAllocator_h
@@ -13,12 +13,31 @@
 // includes
 // --------
 
-#include <algorithm> // count
-#include <memory>    // allocator
+#include <algorithm>     // count
+#include <cstdint>       // uintptr_t
+#include <cstdio>        // remove
+#include <cstring>       // memcpy
+#include <list>          // list
+#include <map>           // map
+#include <memory>        // allocator
+#include <numeric>       // accumulate
+#include <sstream>       // ostringstream
+#include <thread>        // thread
+#include <unordered_map> // unordered_map
+#include <vector>        // vector
+
+#include <sys/wait.h> // waitpid
+#include <unistd.h>   // fork, _exit
 
 #include "gtest/gtest.h"
 
 #include "Allocator.h"
+#include "ArenaAllocator.h"
+#include "CompactAllocator.h"
+#include "ConcurrentAllocator.h"
+#include "GrowableAllocator.h"
+#include "HandleAllocator.h"
+#include "PersistentAllocator.h"
 
 // --------------
 // TestAllocator1
@@ -142,8 +161,8 @@ TEST(TestIndexOperator, index_1)
  */
 TEST(TestIndexOperator, index_2)
 {
-    Allocator<int, 12> x;
-    ASSERT_EQ(x[0], 4);
+    Allocator<int, 16> x;
+    ASSERT_EQ(x[0], 8);
 }
 
 // -----------
@@ -179,7 +198,7 @@ TEST(TestConstructor, exception_is_thrown2)
     bool exception_thrown = false;
     try
     {
-        Allocator<int, 12> x;
+        Allocator<int, 16> x;
     }
     catch(std::bad_alloc& e)
     {
@@ -198,7 +217,7 @@ TEST(TestConstructor, exception_is_thrown3)
     bool exception_thrown = false;
     try
     {
-        Allocator<int, 11> x;
+        Allocator<int, 15> x;
     }
     catch(std::bad_alloc& e)
     {
@@ -248,10 +267,10 @@ TEST(TestAllocate, allocate_1)
     const size_t s = 1;
     x.allocate(s);
     
-    ASSERT_EQ(x[0], -4);
-    ASSERT_EQ(x[8], -4);
-    ASSERT_EQ(x[12], 30);
-    ASSERT_EQ(x[46], 30);
+    ASSERT_EQ(x[0], -8);
+    ASSERT_EQ(x[12], -8);
+    ASSERT_EQ(x[16], 26);
+    ASSERT_EQ(x[46], 26);
 }
 
 /**
@@ -285,18 +304,18 @@ TEST(TestAllocate, allocate_3)
     const size_t s = 1;
 
     x.allocate(s);
-    ASSERT_EQ(x[0], -4);
-    ASSERT_EQ(x[8], -4);
-    ASSERT_EQ(x[12], 80);
-    ASSERT_EQ(x[96], 80);
+    ASSERT_EQ(x[0], -8);
+    ASSERT_EQ(x[12], -8);
+    ASSERT_EQ(x[16], 76);
+    ASSERT_EQ(x[96], 76);
 
     x.allocate(s);
-    ASSERT_EQ(x[0], -4);
-    ASSERT_EQ(x[8], -4);
-    ASSERT_EQ(x[12], -4);
-    ASSERT_EQ(x[20], -4);
-    ASSERT_EQ(x[24], 68);
-    ASSERT_EQ(x[96], 68);
+    ASSERT_EQ(x[0], -8);
+    ASSERT_EQ(x[12], -8);
+    ASSERT_EQ(x[16], -8);
+    ASSERT_EQ(x[28], -8);
+    ASSERT_EQ(x[32], 60);
+    ASSERT_EQ(x[96], 60);
 }
 
 /**
@@ -328,14 +347,14 @@ TEST(TestAllocate, allocate_4)
  */
 TEST(TestAllocate, allocate_5)
 {
-    Allocator<int, 24> x;
+    Allocator<int, 32> x;
     const size_t s = 1;
     x.allocate(s);
 
-    ASSERT_EQ(x[0], -4);
-    ASSERT_EQ(x[8], -4);
-    ASSERT_EQ(x[12], 4);
-    ASSERT_EQ(x[20], 4);
+    ASSERT_EQ(x[0], -8);
+    ASSERT_EQ(x[12], -8);
+    ASSERT_EQ(x[16], 8);
+    ASSERT_EQ(x[28], 8);
 }
 
 /**
@@ -345,20 +364,20 @@ TEST(TestAllocate, allocate_5)
  */
 TEST(TestAllocate, allocate_6)
 {
-    Allocator<int, 24> x;
+    Allocator<int, 32> x;
     const size_t s = 1;
     x.allocate(s);
 
-    ASSERT_EQ(x[0], -4);
-    ASSERT_EQ(x[8], -4);
-    ASSERT_EQ(x[12], 4);
-    ASSERT_EQ(x[20], 4);
+    ASSERT_EQ(x[0], -8);
+    ASSERT_EQ(x[12], -8);
+    ASSERT_EQ(x[16], 8);
+    ASSERT_EQ(x[28], 8);
 
     x.allocate(s);
-    ASSERT_EQ(x[0],  -4);
-    ASSERT_EQ(x[8],  -4);
-    ASSERT_EQ(x[12], -4);
-    ASSERT_EQ(x[20], -4);
+    ASSERT_EQ(x[0],  -8);
+    ASSERT_EQ(x[12], -8);
+    ASSERT_EQ(x[16], -8);
+    ASSERT_EQ(x[28], -8);
 }
 
 /**
@@ -490,7 +509,7 @@ TEST(TestDeallocate, deallocate_4)
  */
 TEST(TestDeallocate, deallocate_5)
 {
-    Allocator<int, 100> x;
+    Allocator<int, 200> x;
     const size_t s = 1;
     int *p1 = x.allocate(s);
     int *p2 = x.allocate(s);
@@ -510,8 +529,8 @@ TEST(TestDeallocate, deallocate_5)
     x.deallocate(p7, s);
     x.deallocate(p8, s);
 
-    ASSERT_EQ(x[0], 92);
-    ASSERT_EQ(x[96], 92);
+    ASSERT_EQ(x[0], 192);
+    ASSERT_EQ(x[196], 192);
 }
 
 // --------------
@@ -556,6 +575,2004 @@ TEST(TestDeallocate, deallocate_6)
     ASSERT_EQ(x[196], 192);
 }
 
+// ---------
+// free list
+// ---------
+
+/**
+ * Tests that a new allocator's only block is in its size class
+ * @param TestFreeList a fixture
+ * @param free_list_1 test name
+ */
+TEST(TestFreeList, free_list_1)
+{
+    Allocator<int, 100> x;
+    ASSERT_EQ(x.bin_head(92), 0);
+    ASSERT_EQ(x.next_free(0), -1);
+}
+
+/**
+ * Tests that allocate skips the busy blocks and reuses a freed block
+ * @param TestFreeList a fixture
+ * @param free_list_2 test name
+ */
+TEST(TestFreeList, free_list_2)
+{
+    Allocator<int, 100> x;
+    const size_t s = 2;
+    int* p1 = x.allocate(s);
+    int* p2 = x.allocate(s);
+    int* p3 = x.allocate(s);
+
+    x.deallocate(p2, s);
+    ASSERT_EQ(x.bin_head(8), 16);
+    ASSERT_EQ(x.bin_head(44), 48);
+
+    ASSERT_EQ(x.allocate(s), p2);
+    ASSERT_EQ(x.bin_head(8), -1);
+
+    x.deallocate(p1, s);
+    x.deallocate(p3, s);
+    x.deallocate(p2, s);
+    ASSERT_EQ(x.bin_head(92), 0);
+    ASSERT_EQ(x[0], 92);
+}
+
+/**
+ * Tests that a request smaller than the links still gets a block that can
+ * hold them, so that the block is in a size class once it is freed
+ * @param TestFreeList a fixture
+ * @param free_list_3 test name
+ */
+TEST(TestFreeList, free_list_3)
+{
+    Allocator<int, 32> x;
+    const size_t s = 1;
+    int* p = x.allocate(s);
+    ASSERT_EQ(x[0], -8);
+    ASSERT_EQ(x.bin_head(8), 16);
+
+    int* q = x.allocate(s);
+    ASSERT_EQ(q, p + 4);
+    ASSERT_EQ(x.fl_bitmap, 0);
+
+    x.deallocate(p, s);
+    ASSERT_EQ(x.bin_head(8), 0);
+    ASSERT_EQ(x[0], 8);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that a small request after many small frees is served from a size
+ * class with one look, and not by walking the blocks
+ * @param TestFreeList a fixture
+ * @param free_list_4 test name
+ */
+TEST(TestFreeList, free_list_4)
+{
+    Allocator<char, 4000> x(allocator_lazy);
+    std::vector<char*> v;
+    for (int i = 0; i != 200; ++i)
+    {
+        v.push_back(x.allocate(1));
+    }
+    for (int i = 0; i < 200; i += 2)
+    {
+        x.deallocate(v[i], 1);
+    }
+    std::size_t scanned = x.stats().blocks_scanned;
+    char* p = x.allocate(5);
+    ASSERT_EQ(x.stats().blocks_scanned, scanned + 1);
+    ASSERT_NE(std::find(v.begin(), v.end(), p), v.end());
+    ASSERT_TRUE(x.check());
+}
+
+// ------------
+// size classes
+// ------------
+
+/**
+ * Tests the mapping of small sizes to size classes
+ * @param TestSizeClasses a fixture
+ * @param mapping_1 test name
+ */
+TEST(TestSizeClasses, mapping_1)
+{
+    int fl;
+    int sl;
+    Allocator<int, 100>::mapping(8, fl, sl);
+    ASSERT_EQ(fl, 1);
+    ASSERT_EQ(sl, 0);
+
+    Allocator<int, 100>::mapping(15, fl, sl);
+    ASSERT_EQ(fl, 1);
+    ASSERT_EQ(sl, 7);
+}
+
+/**
+ * Tests the mapping of larger sizes to size classes
+ * @param TestSizeClasses a fixture
+ * @param mapping_2 test name
+ */
+TEST(TestSizeClasses, mapping_2)
+{
+    int fl;
+    int sl;
+    Allocator<int, 100>::mapping(92, fl, sl);
+    ASSERT_EQ(fl, 4);
+    ASSERT_EQ(sl, 3);
+
+    Allocator<int, 100>::mapping(95, fl, sl);
+    ASSERT_EQ(fl, 4);
+    ASSERT_EQ(sl, 3);
+}
+
+/**
+ * Tests that find_free picks a block from a bigger class, not a first fit
+ * @param TestSizeClasses a fixture
+ * @param find_free_1 test name
+ */
+TEST(TestSizeClasses, find_free_1)
+{
+    Allocator<int, 200> x;
+    int* p1 = x.allocate(10);
+    int* p2 = x.allocate(1);
+    int* p3 = x.allocate(3);
+    x.allocate(1);
+    x.deallocate(p1, 10);
+    x.deallocate(p3, 3);
+
+    // Blocks of 40 and 12 are free: 12 is the smaller class that fits
+    ASSERT_EQ(x.find_free(12), 64);
+    ASSERT_EQ(x.find_free(9), 64);
+    ASSERT_EQ(x.find_free(13), 0);
+    x.deallocate(p2, 1);
+}
+
+/**
+ * Tests that find_free falls back to the request's own class
+ * @param TestSizeClasses a fixture
+ * @param find_free_2 test name
+ */
+TEST(TestSizeClasses, find_free_2)
+{
+    Allocator<int, 100> x;
+    ASSERT_EQ(x.find_free(92), 0);
+    ASSERT_EQ(x.find_free(93), -1);
+}
+
+// ---------
+// placement
+// ---------
+
+/**
+ * The offset of p from the beginning of the heap of x
+ * @param x the allocator that p is from
+ * @param p a pointer returned by x.allocate
+ */
+template <typename A>
+long offset_of (const A& x, const void* p)
+{
+    return static_cast<const char*>(p) - reinterpret_cast<const char*>(&x[0]);
+}
+
+/**
+ * Leaves holes of 80, 20 and 40 bytes at offsets 0, 104 and 148 of a
+ * 400 byte heap, in front of a free block of 180 bytes at offset 212
+ * @param x the allocator to fragment
+ */
+template <typename A>
+void make_holes (A& x)
+{
+    int* p1 = x.allocate(20);
+    x.allocate(1);
+    int* p3 = x.allocate(5);
+    x.allocate(1);
+    int* p5 = x.allocate(10);
+    x.allocate(1);
+    x.deallocate(p1, 20);
+    x.deallocate(p3, 5);
+    x.deallocate(p5, 10);
+}
+
+/**
+ * Tests that FirstFit takes the first hole that fits
+ * @param TestPlacement a fixture
+ * @param first_fit test name
+ */
+TEST(TestPlacement, first_fit)
+{
+    Allocator<int, 400, FirstFit> x;
+    make_holes(x);
+    ASSERT_EQ(offset_of(x, x.allocate(5)), 4);
+    ASSERT_EQ(offset_of(x, x.allocate(10)), 32);
+}
+
+/**
+ * Tests that NextFit carries on from the previous search
+ * @param TestPlacement a fixture
+ * @param next_fit test name
+ */
+TEST(TestPlacement, next_fit)
+{
+    Allocator<int, 400, NextFit> x;
+    make_holes(x);
+    ASSERT_EQ(offset_of(x, x.allocate(5)), 216);
+    ASSERT_EQ(offset_of(x, x.allocate(1)), 244);
+}
+
+/**
+ * Tests that BestFit takes the smallest hole that fits
+ * @param TestPlacement a fixture
+ * @param best_fit test name
+ */
+TEST(TestPlacement, best_fit)
+{
+    Allocator<int, 400, BestFit> x;
+    make_holes(x);
+    ASSERT_EQ(offset_of(x, x.allocate(5)), 108);
+    ASSERT_EQ(offset_of(x, x.allocate(9)), 152);
+}
+
+/**
+ * Tests that WorstFit takes the biggest hole
+ * @param TestPlacement a fixture
+ * @param worst_fit test name
+ */
+TEST(TestPlacement, worst_fit)
+{
+    Allocator<int, 400, WorstFit> x;
+    make_holes(x);
+    ASSERT_EQ(offset_of(x, x.allocate(1)), 216);
+
+    bool exception_thrown = false;
+    try
+    {
+        x.allocate(50);
+    }
+    catch(std::bad_alloc& e)
+    {
+        exception_thrown = true;
+    }
+    ASSERT_TRUE(exception_thrown);
+}
+
+// -----
+// check
+// -----
+
+/**
+ * Tests that the blocks of a valid heap pass the local check
+ * @param TestCheck a fixture
+ * @param valid_block_1 test name
+ */
+TEST(TestCheck, valid_block_1)
+{
+    Allocator<int, 100> x;
+    ASSERT_TRUE(x.valid_block(0));
+
+    int* p = x.allocate(2);
+    x.allocate(1);
+    x.deallocate(p, 2);
+    ASSERT_TRUE(x.valid_block(0));
+    ASSERT_TRUE(x.valid_block(16));
+    ASSERT_TRUE(x.valid_block(32));
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that a broken end sentinel fails the block and its neighbour
+ * @param TestCheck a fixture
+ * @param valid_block_2 test name
+ */
+TEST(TestCheck, valid_block_2)
+{
+    Allocator<int, 100> x;
+    x.allocate(1);
+    x[12] = -5;
+    ASSERT_FALSE(x.valid_block(0));
+    ASSERT_FALSE(x.valid_block(16));
+    ASSERT_FALSE(x.check());
+}
+
+/**
+ * Tests that uncoalesced free blocks and broken links fail the check
+ * @param TestCheck a fixture
+ * @param valid_block_3 test name
+ */
+TEST(TestCheck, valid_block_3)
+{
+    Allocator<int, 100> x;
+    x.allocate(2);
+    x[0]  = 8;
+    x[12] = 8;
+    ASSERT_FALSE(x.valid_block(0));
+    ASSERT_FALSE(x.valid_block(16));
+
+    Allocator<int, 100> y;
+    y[4] = 0;
+    ASSERT_FALSE(y.valid_block(0));
+}
+
+// -----
+// stats
+// -----
+
+/**
+ * Tests the counters of allocate and deallocate
+ * @param TestStats a fixture
+ * @param stats_1 test name
+ */
+TEST(TestStats, stats_1)
+{
+    Allocator<int, 100> x;
+    int* p1 = x.allocate(2);
+    int* p2 = x.allocate(3);
+    AllocatorStats s = x.stats();
+    ASSERT_EQ(s.allocations, 2);
+    ASSERT_EQ(s.live_bytes, 20);
+    ASSERT_EQ(s.free_bytes, 56);
+    ASSERT_EQ(s.largest_free, 56);
+    ASSERT_EQ(s.histogram[3], 2);
+    ASSERT_EQ(s.histogram[2], 0);
+
+    x.deallocate(p1, 2);
+    x.deallocate(p2, 3);
+    s = x.stats();
+    ASSERT_EQ(s.deallocations, 2);
+    ASSERT_EQ(s.coalesces, 2);
+    ASSERT_EQ(s.live_bytes, 0);
+    ASSERT_EQ(s.high_water, 20);
+    ASSERT_EQ(s.free_bytes, 92);
+    ASSERT_EQ(s.fragmentation(), 0);
+}
+
+/**
+ * Tests fragmentation, failures and the blocks scanned
+ * @param TestStats a fixture
+ * @param stats_2 test name
+ */
+TEST(TestStats, stats_2)
+{
+    Allocator<int, 100, FirstFit> x;
+    int* p1 = x.allocate(4);
+    x.allocate(1);
+    x.deallocate(p1, 4);
+    try
+    {
+        x.allocate(20);
+    }
+    catch(std::bad_alloc& e)
+    {
+    }
+    AllocatorStats s = x.stats();
+    ASSERT_EQ(s.failures, 1);
+    ASSERT_EQ(s.free_bytes, 16 + 52);
+    ASSERT_EQ(s.largest_free, 52);
+    ASSERT_DOUBLE_EQ(s.fragmentation(), 16.0 / 68);
+    ASSERT_EQ(s.blocks_scanned, 1 + 2 + 3);
+}
+
+/**
+ * Tests the JSON dump
+ * @param TestStats a fixture
+ * @param stats_3 test name
+ */
+TEST(TestStats, stats_3)
+{
+    Allocator<int, 100> x;
+    x.allocate(1);
+    std::ostringstream out;
+    x.stats().write_json(out);
+    ASSERT_EQ(out.str().find("{\"live_bytes\":8,\"high_water\":8,"), 0);
+    ASSERT_NE(out.str().find("\"histogram\":[0,0,1,0,"), std::string::npos);
+    ASSERT_EQ(out.str().back(), '}');
+}
+
+// ----------
+// concurrent
+// ----------
+
+/**
+ * Tests that threads allocating and deallocating at once leave every arena
+ * as it started
+ * @param TestConcurrent a fixture
+ * @param concurrent_1 test name
+ */
+TEST(TestConcurrent, concurrent_1)
+{
+    typedef ConcurrentAllocator<int, 1000, 4> A;
+    A x;
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 4; ++t)
+    {
+        threads.push_back(std::thread([&x, t] ()
+        {
+            for (int i = 0; i != 1000; ++i)
+            {
+                int* p = x.allocate(1 + (i + t) % 3);
+                x.construct(p, i);
+                int* q = x.allocate(2);
+                ASSERT_EQ(*p, i);
+                x.deallocate(p, 1 + (i + t) % 3);
+                x.deallocate(q, 2);
+            }
+        }));
+    }
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+    for (int i = 0; i != 4; ++i)
+    {
+        const Allocator<int, 1000>& h = x.arenas[i].heap;
+        ASSERT_EQ(h[0], 992);
+        ASSERT_EQ(h[996], 992);
+    }
+}
+
+/**
+ * Tests that a thread takes over another arena when its own is exhausted
+ * @param TestConcurrent a fixture
+ * @param concurrent_2 test name
+ */
+TEST(TestConcurrent, concurrent_2)
+{
+    typedef ConcurrentAllocator<int, 100, 2> A;
+    A x;
+    int* p1 = x.allocate(23);
+    int* p2 = x.allocate(23);
+    ASSERT_NE(x.owner(p1), x.owner(p2));
+    try
+    {
+        x.allocate(1);
+        ASSERT_TRUE(false);
+    }
+    catch(std::bad_alloc& e)
+    {
+    }
+    x.deallocate(p1, 23);
+    int* p3 = x.allocate(1);
+    ASSERT_EQ(x.owner(p3), x.owner(p1));
+    x.deallocate(p2, 23);
+    x.deallocate(p3, 1);
+}
+
+/**
+ * Tests that a block freed by another thread waits on the remote stack until
+ * its arena next allocates
+ * @param TestConcurrent a fixture
+ * @param concurrent_3 test name
+ */
+TEST(TestConcurrent, concurrent_3)
+{
+    typedef ConcurrentAllocator<int, 100, 4> A;
+    A x;
+    std::thread([&x] ()
+    {
+        int* p = x.allocate(5);
+        const Allocator<int, 100>& h = x.owner(p)->heap;
+        std::thread([&x, p] () {x.deallocate(p, 5);}).join();
+        ASSERT_EQ(h[0], -20);
+        ASSERT_NE(x.owner(p)->remote, -1);
+        int* q = x.allocate(1);
+        ASSERT_EQ(x.owner(p)->remote, -1);
+        ASSERT_EQ(q, p);
+        ASSERT_EQ(h[0], -8);
+        ASSERT_EQ(h[16], 76);
+        x.deallocate(q, 1);
+        ASSERT_EQ(h[0], 92);
+    }).join();
+}
+
+/**
+ * Tests that a pointer from elsewhere is refused
+ * @param TestConcurrent a fixture
+ * @param concurrent_4 test name
+ */
+TEST(TestConcurrent, concurrent_4)
+{
+    typedef ConcurrentAllocator<int, 100, 2> A;
+    A x;
+    int i = 0;
+    try
+    {
+        x.deallocate(&i, 1);
+        ASSERT_TRUE(false);
+    }
+    catch(std::invalid_argument& e)
+    {
+    }
+}
+
+/**
+ * Tests that draining many remote frees coalesces them back into one block
+ * @param TestConcurrent a fixture
+ * @param concurrent_5 test name
+ */
+TEST(TestConcurrent, concurrent_5)
+{
+    typedef ConcurrentAllocator<int, 1000, 2> A;
+    A x;
+    std::vector<int*> v;
+    std::thread([&x, &v] ()
+    {
+        for (int i = 0; i != 60; ++i)
+        {
+            v.push_back(x.allocate(2));
+        }
+    }).join();
+    std::thread([&x, &v] ()
+    {
+        for (int i = 0; i != 60; ++i)
+        {
+            x.deallocate(v[(i * 7) % 60], 2);
+        }
+    }).join();
+    A::arena& a = *x.owner(v[0]);
+    const Allocator<int, 1000>& h = a.heap;
+    ASSERT_EQ(h[0], -8);
+    A::drain(a);
+    ASSERT_EQ(a.remote, -1);
+    ASSERT_EQ(h[0], 992);
+}
+
+/**
+ * Tests that freeing a block twice before its arena drains it is refused,
+ * from another thread and from the arena's own
+ * @param TestConcurrent a fixture
+ * @param concurrent_6 test name
+ */
+TEST(TestConcurrent, concurrent_6)
+{
+    typedef ConcurrentAllocator<int, 100, 4> A;
+    A x;
+    std::thread([&x] ()
+    {
+        int* p = x.allocate(5);
+        std::thread([&x, p] ()
+        {
+            x.deallocate(p, 5);
+            ASSERT_THROW(x.deallocate(p, 5), std::invalid_argument);
+        }).join();
+        ASSERT_THROW(x.deallocate(p, 5), std::invalid_argument);
+        int* q = x.allocate(5);
+        ASSERT_EQ(q, p);
+        ASSERT_TRUE(x.owner(q)->heap.check());
+        x.deallocate(q, 5);
+    }).join();
+}
+
+/**
+ * Tests that a block drain cannot give back does not lose the others
+ * @param TestConcurrent a fixture
+ * @param concurrent_7 test name
+ */
+TEST(TestConcurrent, concurrent_7)
+{
+    typedef ConcurrentAllocator<int, 100, 2> A;
+    A x;
+    int* p = x.allocate(4);
+    int* q = x.allocate(2);
+    A::arena& a = *x.owner(p);
+    const Allocator<int, 100>& h = a.heap;
+    A::push_remote(a, q, 2);
+    A::push_remote(a, p + 1, 2);
+    A::drain(a);
+    ASSERT_EQ(a.remote, -1);
+    ASSERT_EQ(h[0], -16);
+    ASSERT_EQ(h[24], 68);
+    x.deallocate(p, 4);
+    ASSERT_EQ(h[0], 92);
+}
+
+// ----------
+// reallocate
+// ----------
+
+/**
+ * Tests growing into the free block that follows
+ * @param TestReallocate a fixture
+ * @param try_expand_1 test name
+ */
+TEST(TestReallocate, try_expand_1)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* p = x.allocate(2);
+    ASSERT_TRUE(x.try_expand(p, 2, 5));
+    ASSERT_EQ(c[0], -20);
+    ASSERT_EQ(c[24], -20);
+    ASSERT_EQ(c[28], 64);
+    ASSERT_EQ(c[96], 64);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that a block followed by a busy block cannot grow
+ * @param TestReallocate a fixture
+ * @param try_expand_2 test name
+ */
+TEST(TestReallocate, try_expand_2)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* p = x.allocate(2);
+    x.allocate(2);
+    ASSERT_FALSE(x.try_expand(p, 2, 3));
+    ASSERT_EQ(c[0], -8);
+    ASSERT_TRUE(x.try_expand(p, 2, 2));
+}
+
+/**
+ * Tests shrinking into the free block that follows
+ * @param TestReallocate a fixture
+ * @param try_shrink_1 test name
+ */
+TEST(TestReallocate, try_shrink_1)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* p = x.allocate(10);
+    ASSERT_TRUE(x.try_shrink(p, 10, 2));
+    ASSERT_EQ(c[0], -8);
+    ASSERT_EQ(c[16], 76);
+    ASSERT_EQ(c[96], 76);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that space too small for a block of its own stays busy
+ * @param TestReallocate a fixture
+ * @param try_shrink_2 test name
+ */
+TEST(TestReallocate, try_shrink_2)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* p = x.allocate(3);
+    x.allocate(1);
+    ASSERT_FALSE(x.try_shrink(p, 3, 2));
+    ASSERT_EQ(c[0], -12);
+}
+
+/**
+ * Tests sliding down into the free block before
+ * @param TestReallocate a fixture
+ * @param reallocate_1 test name
+ */
+TEST(TestReallocate, reallocate_1)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* p1 = x.allocate(2);
+    int* p2 = x.allocate(2);
+    x.allocate(2);
+    x.deallocate(p1, 2);
+    p2[0] = 7;
+    p2[1] = 8;
+    int* q = x.reallocate(p2, 2, 6);
+    ASSERT_EQ(q, p1);
+    ASSERT_EQ(q[0], 7);
+    ASSERT_EQ(q[1], 8);
+    ASSERT_EQ(c[0], -24);
+    ASSERT_EQ(c[32], -8);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests moving when neither neighbour is free
+ * @param TestReallocate a fixture
+ * @param reallocate_2 test name
+ */
+TEST(TestReallocate, reallocate_2)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* p1 = x.allocate(2);
+    x.allocate(2);
+    p1[0] = 7;
+    p1[1] = 8;
+    int* q = x.reallocate(p1, 2, 4);
+    ASSERT_NE(q, p1);
+    ASSERT_EQ(q[0], 7);
+    ASSERT_EQ(q[1], 8);
+    ASSERT_EQ(c[0], 8);
+    ASSERT_EQ(c[32], -16);
+}
+
+/**
+ * Tests reallocate from and to nothing
+ * @param TestReallocate a fixture
+ * @param reallocate_3 test name
+ */
+TEST(TestReallocate, reallocate_3)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* p = x.reallocate(nullptr, 0, 3);
+    ASSERT_EQ(c[0], -12);
+    ASSERT_EQ(x.reallocate(p, 3, 0), nullptr);
+    ASSERT_EQ(c[0], 92);
+}
+
+// ----
+// bulk
+// ----
+
+/**
+ * Tests that a batch is carved out of one free block, in address order
+ * @param TestBulk a fixture
+ * @param bulk_1 test name
+ */
+TEST(TestBulk, bulk_1)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* out[5];
+    x.allocate_bulk(2, 5, out);
+    for (int i = 0; i != 5; ++i)
+    {
+        ASSERT_EQ(out[i], out[0] + 4 * i);
+        ASSERT_EQ(c[16 * i], -8);
+    }
+    ASSERT_EQ(c[80], 12);
+    ASSERT_EQ(c[96], 12);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that a batch in any order coalesces back into one block
+ * @param TestBulk a fixture
+ * @param bulk_2 test name
+ */
+TEST(TestBulk, bulk_2)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* out[5];
+    x.allocate_bulk(2, 5, out);
+    int* kept = x.allocate(1);
+    int* ptrs[] = {out[3], out[0], out[4], out[1]};
+    x.deallocate_bulk(ptrs, 4, 2);
+    ASSERT_EQ(c[0], 24);
+    ASSERT_EQ(c[32], -8);
+    ASSERT_EQ(c[48], 24);
+    ASSERT_EQ(c[80], -12);
+    int* rest[] = {out[2]};
+    x.deallocate(kept, 1);
+    x.deallocate_bulk(rest, 1, 2);
+    ASSERT_EQ(c[0], 92);
+    ASSERT_EQ(x.stats().coalesces, 5);
+}
+
+/**
+ * Tests that a batch that does not fit allocates nothing
+ * @param TestBulk a fixture
+ * @param bulk_3 test name
+ */
+TEST(TestBulk, bulk_3)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* out[7];
+    try
+    {
+        x.allocate_bulk(2, 7, out);
+        ASSERT_TRUE(false);
+    }
+    catch(std::bad_alloc& e)
+    {
+    }
+    ASSERT_EQ(c[0], 92);
+}
+
+/**
+ * Tests that a repeated pointer deallocates nothing
+ * @param TestBulk a fixture
+ * @param bulk_4 test name
+ */
+TEST(TestBulk, bulk_4)
+{
+    Allocator<int, 100> x;
+    const Allocator<int, 100>& c = x;
+    int* out[2];
+    x.allocate_bulk(2, 2, out);
+    int* ptrs[] = {out[1], out[0], out[1]};
+    try
+    {
+        x.deallocate_bulk(ptrs, 3, 2);
+        ASSERT_TRUE(false);
+    }
+    catch(std::invalid_argument& e)
+    {
+    }
+    ASSERT_EQ(c[0], -8);
+    ASSERT_EQ(c[16], -8);
+}
+
+// --------
+// growable
+// --------
+
+/**
+ * Tests that the first chunk is mapped on demand and kept
+ * @param TestGrowable a fixture
+ * @param growable_1 test name
+ */
+TEST(TestGrowable, growable_1)
+{
+    GrowableAllocator<int> x(4096);
+    ASSERT_EQ(x.chunks(), 0);
+    int* p = x.allocate(10);
+    for (int i = 0; i != 10; ++i)
+    {
+        x.construct(p + i, i);
+    }
+    ASSERT_EQ(p[9], 9);
+    ASSERT_EQ(x.chunks(), 1);
+    ASSERT_EQ(x.mapped(), 4096);
+    x.deallocate(p, 10);
+    ASSERT_EQ(x.chunks(), 1);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests growing into more chunks and unmapping them once they are free
+ * @param TestGrowable a fixture
+ * @param growable_2 test name
+ */
+TEST(TestGrowable, growable_2)
+{
+    GrowableAllocator<double> x(4096);
+    std::vector<double*> v;
+    for (int i = 0; i != 200; ++i)
+    {
+        v.push_back(x.allocate(8));
+    }
+    ASSERT_GT(x.chunks(), 2);
+    ASSERT_TRUE(x.check());
+    for (double* p : v)
+    {
+        x.deallocate(p, 8);
+    }
+    ASSERT_EQ(x.chunks(), 1);
+    ASSERT_EQ(x.mapped(), 4096);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests a request larger than a chunk
+ * @param TestGrowable a fixture
+ * @param growable_3 test name
+ */
+TEST(TestGrowable, growable_3)
+{
+    GrowableAllocator<int> x(4096);
+    int* p = x.allocate(1);
+    int* q = x.allocate(100000);
+    q[99999] = 1;
+    ASSERT_EQ(x.chunks(), 2);
+    ASSERT_GE(x.mapped(), 4096 + 400000);
+    x.deallocate(q, 100000);
+    ASSERT_EQ(x.chunks(), 1);
+    ASSERT_EQ(x.mapped(), 4096);
+    x.deallocate(p, 1);
+}
+
+/**
+ * Tests that the ceiling is the only limit
+ * @param TestGrowable a fixture
+ * @param growable_4 test name
+ */
+TEST(TestGrowable, growable_4)
+{
+    GrowableAllocator<int> x(4096, 8192);
+    x.allocate(500);
+    x.allocate(600);
+    ASSERT_EQ(x.mapped(), 8192);
+    try
+    {
+        x.allocate(1000);
+        ASSERT_TRUE(false);
+    }
+    catch(std::bad_alloc& e)
+    {
+    }
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that a broken tag is caught
+ * @param TestGrowable a fixture
+ * @param growable_5 test name
+ */
+TEST(TestGrowable, growable_5)
+{
+    GrowableAllocator<int> x(4096);
+    int* p = x.allocate(4);
+    char* block = reinterpret_cast<char*>(p) - sizeof(std::ptrdiff_t);
+    ASSERT_TRUE(x.valid_block(block));
+    reinterpret_cast<std::ptrdiff_t*>(p)[-1] = -24;
+    ASSERT_FALSE(x.valid_block(block));
+    reinterpret_cast<std::ptrdiff_t*>(p)[-1] = -16;
+    x.deallocate(p, 4);
+}
+
+/**
+ * Tests chunks of huge pages, reserved or transparent
+ * @param TestGrowable a fixture
+ * @param growable_6 test name
+ */
+TEST(TestGrowable, growable_6)
+{
+    GrowableAllocator<char> x(1, SIZE_MAX, true);
+    char* p = x.allocate(100);
+    p[99] = 'a';
+    ASSERT_EQ(x.mapped(), 1 << 21);
+    x.deallocate(p, 100);
+    ASSERT_TRUE(x.check());
+}
+
+// ----------
+// persistent
+// ----------
+
+/**
+ * A list node that can live in a PersistentAllocator
+ */
+struct node
+{
+    int              value;
+    offset_ptr<node> next;
+};
+
+typedef PersistentAllocator<node, 4096> persistent_heap;
+
+/**
+ * Builds the list 0, 1, 2 in x and makes its head the root
+ */
+void make_list (persistent_heap& x)
+{
+    offset_ptr<node> head;
+    for (int i = 2; i >= 0; --i)
+    {
+        node* n = x.allocate(1);
+        n->value = i;
+        n->next  = head;
+        head     = n;
+    }
+    x.set_root(head.get());
+}
+
+/**
+ * Whether the root of x is the list 0, 1, 2
+ */
+bool has_list (const persistent_heap& x)
+{
+    int i = 0;
+    for (node* n = x.root(); n != nullptr; n = n->next.get())
+    {
+        if (n->value != i++)
+        {
+            return false;
+        }
+    }
+    return i == 3;
+}
+
+/**
+ * Tests that a heap copied to another address can be attached and read
+ * @param TestPersistent a fixture
+ * @param persistent_1 test name
+ */
+TEST(TestPersistent, persistent_1)
+{
+    const std::size_t words = persistent_heap::size() / sizeof(std::uint64_t) + 1;
+    std::vector<std::uint64_t> a(words);
+    std::vector<std::uint64_t> b(words);
+    {
+        persistent_heap x(a.data(), persistent_heap::size(), persistent_create);
+        make_list(x);
+    }
+    std::memcpy(b.data(), a.data(), persistent_heap::size());
+    std::fill(a.begin(), a.end(), 0);
+    persistent_heap y(b.data(), persistent_heap::size(), persistent_attach);
+    ASSERT_TRUE(has_list(y));
+    node* n = y.allocate(1);
+    y.deallocate(n, 1);
+}
+
+/**
+ * Tests that a heap in a file outlives the object that made it
+ * @param TestPersistent a fixture
+ * @param persistent_2 test name
+ */
+TEST(TestPersistent, persistent_2)
+{
+    const char* path = "TestAllocator.heap";
+    {
+        persistent_heap x(path, persistent_create);
+        make_list(x);
+    }
+    {
+        persistent_heap y(path, persistent_attach);
+        ASSERT_TRUE(has_list(y));
+    }
+    std::remove(path);
+    try
+    {
+        persistent_heap z(path, persistent_attach);
+        ASSERT_TRUE(false);
+    }
+    catch (std::runtime_error& e)
+    {
+    }
+}
+
+/**
+ * Tests that attaching to a corrupt heap fails
+ * @param TestPersistent a fixture
+ * @param persistent_3 test name
+ */
+TEST(TestPersistent, persistent_3)
+{
+    std::vector<std::uint64_t> a(persistent_heap::size() / sizeof(std::uint64_t) + 1);
+    {
+        persistent_heap x(a.data(), persistent_heap::size(), persistent_create);
+        node* n = x.allocate(1);
+        reinterpret_cast<int*>(n)[-1] = 5;
+    }
+    try
+    {
+        persistent_heap y(a.data(), persistent_heap::size(), persistent_attach);
+        ASSERT_TRUE(false);
+    }
+    catch (std::runtime_error& e)
+    {
+    }
+}
+
+/**
+ * Tests a heap that another process writes through shared memory
+ * @param TestPersistent a fixture
+ * @param persistent_4 test name
+ */
+TEST(TestPersistent, persistent_4)
+{
+    const char* name = "/TestAllocator.heap";
+    persistent_heap x(name, persistent_create, persistent_shm);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        persistent_heap y(name, persistent_attach, persistent_shm);
+        make_list(y);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    shm_unlink(name);
+    ASSERT_EQ(status, 0);
+    ASSERT_TRUE(has_list(x));
+    ASSERT_TRUE(x.check());
+}
+
+// -------
+// compact
+// -------
+
+/**
+ * Tests that a busy block has a header and no footer
+ * @param TestCompact a fixture
+ * @param compact_1 test name
+ */
+TEST(TestCompact, compact_1)
+{
+    CompactAllocator<int, 100> x;
+    const CompactAllocator<int, 100>& c = x;
+    ASSERT_EQ(c[0], 100);
+    ASSERT_EQ(c[96], 100);
+    int* p = x.allocate(2);
+    ASSERT_EQ(reinterpret_cast<char*>(p), reinterpret_cast<const char*>(&c[0]) + 4);
+    ASSERT_EQ(c[0], 12 | 1);
+    ASSERT_EQ(c[12], 88);
+    ASSERT_EQ(c[96], 88);
+    x.deallocate(p, 2);
+    ASSERT_EQ(c[0], 100);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests the previous-free bit and coalescing in both directions
+ * @param TestCompact a fixture
+ * @param compact_2 test name
+ */
+TEST(TestCompact, compact_2)
+{
+    CompactAllocator<int, 100> x;
+    const CompactAllocator<int, 100>& c = x;
+    int* p1 = x.allocate(2);
+    int* p2 = x.allocate(2);
+    int* p3 = x.allocate(2);
+    x.deallocate(p2, 2);
+    ASSERT_EQ(c[12], 12);
+    ASSERT_EQ(c[20], 12);
+    ASSERT_EQ(c[24], 12 | 2 | 1);
+    x.deallocate(p3, 2);
+    ASSERT_EQ(c[12], 88);
+    x.deallocate(p1, 2);
+    ASSERT_EQ(c[0], 100);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that more blocks fit than in Allocator
+ * @param TestCompact a fixture
+ * @param compact_3 test name
+ */
+TEST(TestCompact, compact_3)
+{
+    Allocator<int, 1000>        x;
+    CompactAllocator<int, 1000> y;
+    int in_x = 0;
+    int in_y = 0;
+    try
+    {
+        while (true)
+        {
+            x.allocate(1);
+            ++in_x;
+        }
+    }
+    catch (std::bad_alloc& e)
+    {
+    }
+    try
+    {
+        while (true)
+        {
+            y.allocate(1);
+            ++in_y;
+        }
+    }
+    catch (std::bad_alloc& e)
+    {
+    }
+    ASSERT_EQ(in_x, 62);
+    ASSERT_EQ(in_y, 125);
+    ASSERT_TRUE(y.check());
+}
+
+/**
+ * Tests that valid_block catches a wrong previous-free bit
+ * @param TestCompact a fixture
+ * @param compact_4 test name
+ */
+TEST(TestCompact, compact_4)
+{
+    CompactAllocator<double, 100> x;
+    x.allocate(1);
+    double* p = x.allocate(1);
+    ASSERT_TRUE(x.valid_block(0));
+    reinterpret_cast<int*>(p)[-1] |= 2;
+    ASSERT_FALSE(x.valid_block(0));
+    ASSERT_FALSE(x.check());
+}
+
+/**
+ * Tests that payloads are aligned for T, with blocks rounded to match
+ * @param TestCompact a fixture
+ * @param compact_5 test name
+ */
+TEST(TestCompact, compact_5)
+{
+    CompactAllocator<double, 100> x;
+    const CompactAllocator<double, 100>& c = x;
+    ASSERT_EQ(c[0], 96);
+    double* p1 = x.allocate(1);
+    double* p2 = x.allocate(1);
+    ASSERT_EQ(c[0], 16 | 1);
+    ASSERT_EQ(p2 - p1, 2);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(p1) % alignof(double), 0u);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(p2) % alignof(double), 0u);
+    x.deallocate(p1, 1);
+    ASSERT_EQ(c[0], 16);
+    ASSERT_EQ(c[12], 16);
+    x.deallocate(p2, 1);
+    ASSERT_EQ(c[0], 96);
+    ASSERT_TRUE(x.check());
+}
+
+// --------
+// TestSlab
+// --------
+
+/**
+ * Tests that the slab holds as many slots as fit after the bitmap, one T
+ * each
+ * @param TestSlab a fixture
+ * @param slab_1 test name
+ */
+TEST(TestSlab, slab_1)
+{
+    Allocator<double, 100, Slab> x;
+    ASSERT_EQ((Allocator<double, 100, Slab>::capacity()), 11u);
+    ASSERT_EQ((Allocator<char, 64, Slab>::capacity()), 15u);
+    std::vector<double*> v;
+    for (int i = 0; i != 11; ++i)
+    {
+        v.push_back(x.allocate(1));
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(v.back()) % alignof(double), 0u);
+    }
+    for (int i = 1; i != 11; ++i)
+    {
+        ASSERT_EQ(v[i] - v[i - 1], 1);
+    }
+    ASSERT_THROW(x.allocate(1), std::bad_alloc);
+    ASSERT_EQ(x.allocate(0), nullptr);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that a freed slot is the next one handed out, and that requests for
+ * more than one T fail
+ * @param TestSlab a fixture
+ * @param slab_2 test name
+ */
+TEST(TestSlab, slab_2)
+{
+    Allocator<int, 100, Slab> x;
+    int* p = x.allocate(1);
+    int* q = x.allocate(1);
+    x.construct(q, 2);
+    ASSERT_EQ(*q, 2);
+    x.destroy(q);
+    x.deallocate(p, 1);
+    x.deallocate(q, 1);
+    ASSERT_EQ(x.allocate(1), q);
+    ASSERT_EQ(x.allocate(1), p);
+    ASSERT_THROW(x.allocate(2), std::bad_alloc);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that deallocate rejects pointers that are not busy slots
+ * @param TestSlab a fixture
+ * @param slab_3 test name
+ */
+TEST(TestSlab, slab_3)
+{
+    Allocator<int, 100, Slab> x;
+    int  i = 0;
+    int* p = x.allocate(1);
+    ASSERT_THROW(x.deallocate(nullptr, 1), std::invalid_argument);
+    ASSERT_THROW(x.deallocate(&i, 1), std::invalid_argument);
+    ASSERT_THROW(x.deallocate(reinterpret_cast<int*>(reinterpret_cast<char*>(p) + 2), 1),
+                 std::invalid_argument);
+    ASSERT_THROW(x.deallocate(p + 1, 1), std::invalid_argument);
+    x.deallocate(p, 1);
+    ASSERT_THROW(x.deallocate(p, 1), std::invalid_argument);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that check finds a write to a freed slot
+ * @param TestSlab a fixture
+ * @param slab_4 test name
+ */
+TEST(TestSlab, slab_4)
+{
+    Allocator<int, 100, Slab> x;
+    int* p = x.allocate(1);
+    int* q = x.allocate(1);
+    x.deallocate(p, 1);
+    x.deallocate(q, 1);
+    ASSERT_TRUE(x.check());
+    *q = 7;
+    ASSERT_FALSE(x.check());
+}
+
+/**
+ * Tests a std::list and a std::map whose nodes are slots of slabs, one slot
+ * per node, through an ArenaAllocator
+ * @param TestSlab a fixture
+ * @param slab_5 test name
+ */
+TEST(TestSlab, slab_5)
+{
+    typedef Allocator<allocator_node<int, 2>, 1000, Slab> list_slab;
+    list_slab x;
+    {
+        std::list<int, ArenaAllocator<int, list_slab> > l((ArenaAllocator<int, list_slab>(x)));
+        for (int i = 0; i != 10; ++i)
+        {
+            l.push_back(i);
+        }
+        l.remove(3);
+        l.push_front(3);
+        ASSERT_EQ(l.front(), 3);
+        ASSERT_EQ(std::accumulate(l.begin(), l.end(), 0), 45);
+        ASSERT_TRUE(x.owns(&l.back()));
+        ASSERT_EQ(x.stats().live_bytes, 10 * sizeof(allocator_node<int, 2>));
+    }
+    ASSERT_EQ(x.stats().live_bytes, 0);
+    ASSERT_TRUE(x.check());
+
+    typedef std::pair<const int, int>                           entry;
+    typedef Allocator<allocator_node<entry, 4>, 1000, Slab>     map_slab;
+    typedef ArenaAllocator<entry, map_slab>                     map_allocator;
+    map_slab y;
+    {
+        std::map<int, int, std::less<int>, map_allocator> m((std::less<int>()), map_allocator(y));
+        for (int i = 0; i != 20; ++i)
+        {
+            m[i % 7] += i;
+        }
+        ASSERT_EQ(m.size(), 7u);
+        ASSERT_EQ(m[6], 6 + 13);
+        ASSERT_TRUE(y.owns(&*m.begin()));
+    }
+    ASSERT_EQ(y.stats().live_bytes, 0);
+    ASSERT_TRUE(y.check());
+}
+
+// ---------
+// TestArena
+// ---------
+
+/**
+ * Tests that a std::list keeps its nodes in the arena and gives them all
+ * back
+ * @param TestArena a fixture
+ * @param arena_1 test name
+ */
+TEST(TestArena, arena_1)
+{
+    typedef Allocator<char, 10000> arena_type;
+    arena_type x;
+    const arena_type& c = x;
+    {
+        std::list<int, ArenaAllocator<int, arena_type> > l((ArenaAllocator<int, arena_type>(x)));
+        for (int i = 0; i != 100; ++i)
+        {
+            l.push_back(i);
+        }
+        ASSERT_TRUE(x.owns(&l.front()));
+        ASSERT_TRUE(x.owns(&l.back()));
+        ASSERT_EQ(std::accumulate(l.begin(), l.end(), 0), 4950);
+        ASSERT_NE(c[0], 10000 - 8);
+    }
+    ASSERT_EQ(c[0], 10000 - 8);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that handles rebound to other types share the arena, and that
+ * std::map and std::unordered_map work through them
+ * @param TestArena a fixture
+ * @param arena_2 test name
+ */
+TEST(TestArena, arena_2)
+{
+    typedef Allocator<char, 20000> arena_type;
+    typedef ArenaAllocator<std::pair<const int, int>, arena_type> pair_allocator;
+    arena_type x;
+    arena_type y;
+    ArenaAllocator<int, arena_type> a(x);
+    ArenaAllocator<double, arena_type> b(a);
+    ASSERT_TRUE(a == b);
+    ASSERT_TRUE((a != ArenaAllocator<int, arena_type>(y)));
+    ASSERT_TRUE(x != y);
+    {
+        std::map<int, int, std::less<int>, pair_allocator> m((std::less<int>()), pair_allocator(x));
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, pair_allocator>
+            u(0, std::hash<int>(), std::equal_to<int>(), pair_allocator(x));
+        for (int i = 0; i != 100; ++i)
+        {
+            m[i] = i * i;
+            u[i] = i * i;
+        }
+        ASSERT_EQ(m[9], 81);
+        ASSERT_EQ(u[9], 81);
+        ASSERT_TRUE(x.owns(&*m.begin()));
+        ASSERT_TRUE(x.owns(&*u.begin()));
+        ASSERT_TRUE(m.get_allocator() == u.get_allocator());
+    }
+    const arena_type& c = x;
+    ASSERT_EQ(c[0], 20000 - 8);
+}
+
+/**
+ * Tests that move assignment and swap take the arena along with the nodes
+ * @param TestArena a fixture
+ * @param arena_3 test name
+ */
+TEST(TestArena, arena_3)
+{
+    typedef Allocator<char, 10000>                           arena_type;
+    typedef std::list<int, ArenaAllocator<int, arena_type> > list_type;
+    arena_type x;
+    arena_type y;
+    list_type l((ArenaAllocator<int, arena_type>(x)));
+    list_type m((ArenaAllocator<int, arena_type>(y)));
+    l.push_back(1);
+    m.push_back(2);
+    l.swap(m);
+    ASSERT_EQ(&l.get_allocator().arena(), &y);
+    ASSERT_TRUE(y.owns(&l.front()));
+    l = std::move(m);
+    ASSERT_EQ(&l.get_allocator().arena(), &x);
+    ASSERT_EQ(l.front(), 1);
+    ASSERT_TRUE(x.check());
+    ASSERT_TRUE(y.check());
+}
+
+/**
+ * Tests that a full arena makes the container throw bad_alloc and leaves it
+ * as it was
+ * @param TestArena a fixture
+ * @param arena_4 test name
+ */
+TEST(TestArena, arena_4)
+{
+    typedef Allocator<char, 200> arena_type;
+    arena_type x;
+    std::list<int, ArenaAllocator<int, arena_type> > l((ArenaAllocator<int, arena_type>(x)));
+    try
+    {
+        while (true)
+        {
+            l.push_back(0);
+        }
+    }
+    catch (std::bad_alloc& e)
+    {}
+    ASSERT_GT(l.size(), 0u);
+    ASSERT_EQ(l.size(), static_cast<std::size_t>(std::count(l.begin(), l.end(), 0)));
+    ASSERT_TRUE(x.check());
+}
+
+// ---------
+// TestAlign
+// ---------
+
+/**
+ * Eight floats, as wide as one AVX register
+ */
+struct alignas(32) lanes
+{
+    float values[8];
+};
+
+/**
+ * Tests that every block of an over-aligned T is aligned for it
+ * @param TestAlign a fixture
+ * @param align_1 test name
+ */
+TEST(TestAlign, align_1)
+{
+    Allocator<lanes, 1000> x;
+    const Allocator<lanes, 1000>& c = x;
+    lanes* p1 = x.allocate(1);
+    lanes* p2 = x.allocate(3);
+    lanes* p3 = x.allocate(2);
+    ASSERT_EQ(c[0], -56);
+    for (lanes* p : {p1, p2, p3})
+    {
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(p) % 32, 0u);
+    }
+    x.deallocate(p2, 3);
+    lanes* p4 = x.allocate(1);
+    ASSERT_EQ(p4, p2);
+    ASSERT_TRUE(x.check());
+    x.deallocate(p1, 1);
+    x.deallocate(p3, 2);
+    x.deallocate(p4, 1);
+    ASSERT_EQ(c[0], 1000 - 8);
+}
+
+/**
+ * Tests that allocate_aligned splits the padding off as a free block that
+ * coalesces again
+ * @param TestAlign a fixture
+ * @param align_2 test name
+ */
+TEST(TestAlign, align_2)
+{
+    Allocator<int, 1000> x;
+    const Allocator<int, 1000>& c = x;
+    int* p = x.allocate(1);
+    int* q = x.allocate_aligned(16, 64);
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(q) % 64, 0u);
+    ASSERT_GT(c[16], 0);
+    ASSERT_EQ(reinterpret_cast<char*>(q) - reinterpret_cast<char*>(p),
+              16 + 2 * 4 + c[16]);
+    ASSERT_TRUE(x.check());
+    x.deallocate(q, 16);
+    ASSERT_EQ(c[16], 1000 - 16 - 8);
+    x.deallocate(p, 1);
+    ASSERT_EQ(c[0], 1000 - 8);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests the errors of allocate_aligned, and that an ArenaAllocator over a
+ * char arena aligns the nodes it rebinds to
+ * @param TestAlign a fixture
+ * @param align_3 test name
+ */
+TEST(TestAlign, align_3)
+{
+    Allocator<int, 100> x;
+    ASSERT_THROW(x.allocate_aligned(1, 24), std::invalid_argument);
+    ASSERT_THROW(x.allocate_aligned(20, 64), std::bad_alloc);
+    ASSERT_EQ(x.allocate_aligned(0, 64), nullptr);
+    ASSERT_TRUE(x.check());
+
+    typedef Allocator<char, 1000> arena_type;
+    arena_type y;
+    y.allocate(3);
+    std::list<double, ArenaAllocator<double, arena_type> > l((ArenaAllocator<double, arena_type>(y)));
+    for (int i = 0; i != 10; ++i)
+    {
+        l.push_back(i);
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(&l.back()) % alignof(double), 0u);
+    }
+    ASSERT_TRUE(y.check());
+}
+
+/**
+ * Tests that GrowableAllocator pads its chunks and rounds its blocks for an
+ * over-aligned T, across splits, coalescing and a second chunk
+ * @param TestAlign a fixture
+ * @param align_4 test name
+ */
+TEST(TestAlign, align_4)
+{
+    GrowableAllocator<lanes> x(4096);
+    std::vector<lanes*> v;
+    for (int i = 0; i != 80; ++i)
+    {
+        v.push_back(x.allocate(1 + i % 3));
+    }
+    ASSERT_GT(x.chunks(), 1);
+    for (int i = 0; i < 80; i += 2)
+    {
+        x.deallocate(v[i], 1 + i % 3);
+        v[i] = x.allocate(1 + (i + 1) % 3);
+    }
+    for (lanes* p : v)
+    {
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(p) % 32, 0u);
+    }
+    ASSERT_TRUE(x.check());
+    for (int i = 0; i != 80; ++i)
+    {
+        x.deallocate(v[i], 0);
+    }
+    ASSERT_EQ(x.chunks(), 1);
+    ASSERT_TRUE(x.check());
+}
+
+// --------
+// TestLazy
+// --------
+
+/**
+ * Tests that a lazy Allocator writes nothing past the blocks it has handed
+ * out
+ * @param TestLazy a fixture
+ * @param lazy_1 test name
+ */
+TEST(TestLazy, lazy_1)
+{
+    typedef Allocator<int, 1000> allocator_type;
+    alignas(allocator_type) unsigned char buffer[sizeof(allocator_type)];
+    std::memset(buffer, 0x5a, sizeof(buffer));
+    allocator_type& x = *new (buffer) allocator_type(allocator_lazy);
+    const allocator_type& c = x;
+    ASSERT_TRUE(x.check());
+    int* p = x.allocate(1);
+    int* q = x.allocate(5);
+    ASSERT_EQ(c[0], -8);
+    ASSERT_EQ(c[16], -20);
+    unsigned char* begin = reinterpret_cast<unsigned char*>(q + 6);
+    unsigned char* end   = reinterpret_cast<unsigned char*>(p) - sizeof(int) + 1000;
+    ASSERT_EQ(std::count(begin, end, 0x5a), end - begin);
+    x.deallocate(p, 1);
+    x.deallocate(q, 5);
+    ASSERT_EQ(c[0], 44 - 8);
+    ASSERT_TRUE(x.check());
+    x.~allocator_type();
+}
+
+/**
+ * Tests that a lazy Allocator holds as many blocks as an eager one, and
+ * coalesces them all back
+ * @param TestLazy a fixture
+ * @param lazy_2 test name
+ */
+TEST(TestLazy, lazy_2)
+{
+    Allocator<int, 1000> x;
+    Allocator<int, 1000> y(allocator_lazy);
+    const Allocator<int, 1000>& c = y;
+    std::vector<int*> v;
+    std::vector<int*> w;
+    try
+    {
+        while (true)
+        {
+            v.push_back(x.allocate(1));
+        }
+    }
+    catch (std::bad_alloc&)
+    {}
+    try
+    {
+        while (true)
+        {
+            w.push_back(y.allocate(1));
+        }
+    }
+    catch (std::bad_alloc&)
+    {}
+    ASSERT_EQ(v.size(), w.size());
+    ASSERT_TRUE(y.check());
+    for (int* p : w)
+    {
+        y.deallocate(p, 1);
+    }
+    ASSERT_EQ(c[0], 1000 - 8);
+    ASSERT_EQ(c[1000 - 4], 1000 - 8);
+    ASSERT_TRUE(y.check());
+}
+
+/**
+ * Tests that a copy of a lazy Allocator has the same blocks and contents
+ * @param TestLazy a fixture
+ * @param lazy_3 test name
+ */
+TEST(TestLazy, lazy_3)
+{
+    Allocator<int, 1000> x(allocator_lazy);
+    int* p = x.allocate(3);
+    int* q = x.allocate(1);
+    p[0] = 1;
+    p[2] = 3;
+    x.deallocate(q, 1);
+    Allocator<int, 1000> y(x);
+    const Allocator<int, 1000>& c = y;
+    ASSERT_NE(x, y);
+    ASSERT_TRUE(y.check());
+    ASSERT_EQ(c[0], -12);
+    ASSERT_EQ(c[4], 1);
+    ASSERT_EQ(c[12], 3);
+    int* r = y.allocate(100);
+    ASSERT_TRUE(y.check());
+    y.deallocate(r, 100);
+    y = Allocator<int, 1000>();
+    ASSERT_EQ(c[0], 1000 - 8);
+    ASSERT_TRUE(y.check());
+}
+
+// ----------
+// TestHandle
+// ----------
+
+/**
+ * Tests pinning and the errors of a HandleAllocator
+ * @param TestHandle a fixture
+ * @param handle_1 test name
+ */
+TEST(TestHandle, handle_1)
+{
+    HandleAllocator<int, 1000, 2> x;
+    int h = x.allocate(5);
+    int* p = x.pin(h);
+    p[0] = 1;
+    p[4] = 5;
+    ASSERT_EQ(x.arena()[0], -24);
+    ASSERT_EQ(x.arena()[4], h);
+    ASSERT_THROW(x.deallocate(h, 5), std::invalid_argument);
+    x.unpin(h);
+    ASSERT_THROW(x.unpin(h), std::invalid_argument);
+    ASSERT_THROW(x.pin(1), std::invalid_argument);
+    ASSERT_THROW(x.pin(-1), std::invalid_argument);
+    int g = x.allocate(1);
+    ASSERT_THROW(x.allocate(1), std::bad_alloc);
+    ASSERT_TRUE(x.check());
+    x.deallocate(h, 5);
+    x.deallocate(g, 1);
+    ASSERT_THROW(x.deallocate(g, 1), std::invalid_argument);
+    ASSERT_EQ(x.arena()[0], 1000 - 8);
+}
+
+/**
+ * Tests that allocate compacts a fragmented heap rather than fail, and
+ * that the blocks keep their contents when they move
+ * @param TestHandle a fixture
+ * @param handle_2 test name
+ */
+TEST(TestHandle, handle_2)
+{
+    HandleAllocator<int, 1000> x;
+    std::vector<int> v;
+    for (int i = 0; i != 40; ++i)
+    {
+        v.push_back(x.allocate(3));
+        x.pin(v.back())[0] = i;
+        x.unpin(v.back());
+    }
+    for (int i = 0; i != 40; i += 2)
+    {
+        x.deallocate(v[i], 3);
+    }
+    // 20 holes of 24 bytes and 40 bytes at the end
+    int h = x.allocate(100);
+    ASSERT_EQ(x.arena()[0], -16);
+    ASSERT_EQ(x.arena()[4], v[1]);
+    ASSERT_TRUE(x.check());
+    for (int i = 1; i < 40; i += 2)
+    {
+        ASSERT_EQ(x.pin(v[i])[0], i);
+        x.unpin(v[i]);
+    }
+    x.deallocate(h, 100);
+}
+
+/**
+ * Tests that compact works in slices and leaves pinned blocks where they
+ * are
+ * @param TestHandle a fixture
+ * @param handle_3 test name
+ */
+TEST(TestHandle, handle_3)
+{
+    HandleAllocator<double, 2000> x;
+    std::vector<int> v;
+    for (int i = 0; i != 30; ++i)
+    {
+        v.push_back(x.allocate(4));
+        x.pin(v.back())[3] = i;
+        x.unpin(v.back());
+    }
+    for (int i = 0; i != 30; i += 3)
+    {
+        x.deallocate(v[i], 4);
+    }
+    double* p = x.pin(v[16]);
+    int slices = 0;
+    while (!x.compact(64))
+    {
+        ++slices;
+        ASSERT_TRUE(x.check());
+    }
+    ASSERT_GT(slices, 5);
+    ASSERT_EQ(x.pin(v[16]), p);
+    ASSERT_EQ(p[3], 16);
+    x.unpin(v[16]);
+    x.unpin(v[16]);
+    for (int i = 0; i != 30; ++i)
+    {
+        if (i % 3 != 0)
+        {
+            ASSERT_EQ(x.pin(v[i])[3], i);
+            x.unpin(v[i]);
+        }
+    }
+    // Only the hole before the pinned block is left behind
+    ASSERT_GT(x.arena().stats().fragmentation(), 0);
+    x.compact();
+    ASSERT_EQ(x.arena().stats().fragmentation(), 0);
+    ASSERT_TRUE(x.check());
+}
+
+// --------
+// TestNear
+// --------
+
+/**
+ * Tests that allocate_near takes the free block nearest its hint, on
+ * either side
+ * @param TestNear a fixture
+ * @param near_1 test name
+ */
+TEST(TestNear, near_1)
+{
+    Allocator<int, 1000> x;
+    int* p[10];
+    for (int i = 0; i != 10; ++i)
+    {
+        p[i] = x.allocate(1);
+    }
+    x.deallocate(p[8], 1);
+    x.deallocate(p[2], 1);
+    ASSERT_EQ(x.allocate_near(1, p[6]), p[8]);
+    ASSERT_EQ(x.allocate_near(1, p[3]), p[2]);
+    ASSERT_EQ(x.allocate_near(1, p[5]), p[9] + 4);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that allocate_near takes the back of a free block before its hint
+ * @param TestNear a fixture
+ * @param near_2 test name
+ */
+TEST(TestNear, near_2)
+{
+    Allocator<int, 1000> x;
+    const Allocator<int, 1000>& c = x;
+    int* p[5];
+    for (int i = 0; i != 5; ++i)
+    {
+        p[i] = x.allocate(1);
+    }
+    x.deallocate(p[1], 1);
+    x.deallocate(p[2], 1);
+    ASSERT_EQ(c[16], 24);
+    ASSERT_EQ(x.allocate_near(1, p[3]), p[2]);
+    ASSERT_EQ(c[16], 8);
+    ASSERT_EQ(c[32], -8);
+    ASSERT_TRUE(x.check());
+}
+
+/**
+ * Tests that allocate_near falls back to allocate, and its errors
+ * @param TestNear a fixture
+ * @param near_3 test name
+ */
+TEST(TestNear, near_3)
+{
+    Allocator<char, 10000> x;
+    char* h = x.allocate(1);
+    *h = 'a';
+    char* b = x.allocate(5000);
+    char* n = x.allocate_near(10, h);
+    ASSERT_EQ(n, b + 5000 + 8);
+    ASSERT_NE(x.allocate_near(10, nullptr), nullptr);
+    ASSERT_EQ(x.allocate_near(0, h), nullptr);
+    ASSERT_THROW(x.allocate_near(1, h + 1), std::invalid_argument);
+    ASSERT_THROW(x.allocate_near(20000, h), std::bad_alloc);
+    ASSERT_TRUE(x.check());
+}
+
+// ----------
+// TestRecord
+// ----------
+
+/**
+ * Tests that a recorded Allocator writes its operations, with payload
+ * offsets as ids, and that a resize in place is a deallocate and an
+ * allocate of the same id
+ * @param TestRecord a fixture
+ * @param record_1 test name
+ */
+TEST(TestRecord, record_1)
+{
+    const char* path = "TestAllocator.trace";
+    Allocator<int, 100> x;
+    {
+        trace_recorder r(path);
+        x.record(&r);
+        int* p = x.allocate(2);
+        int* q = x.allocate(3);
+        ASSERT_TRUE(x.try_expand(p, 2, 2));
+        x.deallocate(p, 2);
+        x.record(nullptr);
+        x.deallocate(q, 3);
+        r.close();
+    }
+    std::vector<trace_record> trace = read_trace(path);
+    std::remove(path);
+    ASSERT_EQ(trace.size(), 5);
+    ASSERT_EQ(trace[0].op, trace_allocate);
+    ASSERT_EQ(trace[0].id, 4);
+    ASSERT_EQ(trace[0].bytes, 8);
+    ASSERT_EQ(trace[1].id, 20);
+    ASSERT_EQ(trace[1].bytes, 12);
+    ASSERT_EQ(trace[2].op, trace_deallocate);
+    ASSERT_EQ(trace[2].id, 4);
+    ASSERT_EQ(trace[3].op, trace_allocate);
+    ASSERT_EQ(trace[3].id, 4);
+    ASSERT_EQ(trace[4].op, trace_deallocate);
+    ASSERT_EQ(trace[4].bytes, 8);
+    ASSERT_LE(trace[0].time, trace[4].time);
+}
+
+/**
+ * Tests that the ring buffer keeps every record, in order, across many
+ * laps, that close can be called twice, and that a capacity that is not a
+ * power of two is rejected
+ * @param TestRecord a fixture
+ * @param record_2 test name
+ */
+TEST(TestRecord, record_2)
+{
+    const char* path = "TestAllocator.trace";
+    ASSERT_THROW(trace_recorder(path, 6), std::invalid_argument);
+    {
+        trace_recorder r(path, 4);
+        for (std::uint32_t i = 0; i != 100; ++i)
+        {
+            r.record(trace_allocate, i, i);
+        }
+        r.close();
+        r.close();
+    }
+    std::vector<trace_record> trace = read_trace(path);
+    std::remove(path);
+    ASSERT_EQ(trace.size(), 100);
+    for (std::uint32_t i = 0; i != 100; ++i)
+    {
+        ASSERT_EQ(trace[i].id, i);
+        ASSERT_EQ(trace[i].bytes, i);
+    }
+}
+
+/**
+ * Tests that threads can record at once, each in its own order
+ * @param TestRecord a fixture
+ * @param record_3 test name
+ */
+TEST(TestRecord, record_3)
+{
+    const char* path = "TestAllocator.trace";
+    {
+        trace_recorder r(path, 8);
+        std::vector<std::thread> threads;
+        for (std::uint32_t t = 0; t != 4; ++t)
+        {
+            threads.push_back(std::thread([&r, t] ()
+            {
+                for (std::uint32_t i = 0; i != 1000; ++i)
+                {
+                    r.record(trace_deallocate, t, i);
+                }
+            }));
+        }
+        for (std::thread& t : threads)
+        {
+            t.join();
+        }
+        r.close();
+    }
+    std::vector<trace_record> trace = read_trace(path);
+    std::remove(path);
+    ASSERT_EQ(trace.size(), 4000);
+    std::vector<std::uint32_t> next(4, 0);
+    for (const trace_record& r : trace)
+    {
+        ASSERT_EQ(r.bytes, next[r.id]++);
+    }
+}
+
+/**
+ * Tests that deallocate_bulk records the bytes that were requested
+ * @param TestRecord a fixture
+ * @param record_4 test name
+ */
+TEST(TestRecord, record_4)
+{
+    const char* path = "TestAllocator.trace";
+    Allocator<char, 100> x;
+    {
+        trace_recorder r(path);
+        x.record(&r);
+        char* out[2];
+        x.allocate_bulk(3, 2, out);
+        x.deallocate_bulk(out, 2, 3);
+        r.close();
+    }
+    std::vector<trace_record> trace = read_trace(path);
+    std::remove(path);
+    ASSERT_EQ(trace.size(), 4);
+    for (const trace_record& r : trace)
+    {
+        ASSERT_EQ(r.bytes, 3);
+    }
+}
+
 // --------------
 // TestAllocator3
 // --------------